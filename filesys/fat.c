@@ -2,6 +2,7 @@
 #include "devices/disk.h"
 #include "filesys/filesys.h"
 #include "threads/malloc.h"
+#include "threads/scratch.h"
 #include "threads/synch.h"
 #include <stdio.h>
 #include <string.h>
@@ -38,12 +39,13 @@ fat_init (void) {
 		PANIC ("FAT init failed");
 
 	// Read boot sector from the disk
-	unsigned int *bounce = malloc (DISK_SECTOR_SIZE);
+	size_t mark = scratch_mark ();
+	unsigned int *bounce = scratch_alloc (DISK_SECTOR_SIZE);
 	if (bounce == NULL)
 		PANIC ("FAT init failed");
 	disk_read (filesys_disk, FAT_BOOT_SECTOR, bounce);
 	memcpy (&fat_fs->bs, bounce, sizeof (fat_fs->bs));
-	free (bounce);
+	scratch_release (mark);
 
 	// Extract FAT info
 	if (fat_fs->bs.magic != FAT_MAGIC)
@@ -58,7 +60,9 @@ fat_open (void) {
 		PANIC ("FAT load failed");
 
 	// Load FAT directly from the disk
+	size_t mark = scratch_mark ();
 	uint8_t *buffer = (uint8_t *) fat_fs->fat;
+	uint8_t *bounce = NULL;
 	off_t bytes_read = 0;
 	off_t bytes_left = sizeof (fat_fs->fat);
 	const off_t fat_size_in_bytes = fat_fs->fat_length * sizeof (cluster_t);
@@ -69,26 +73,28 @@ fat_open (void) {
 			           buffer + bytes_read);
 			bytes_read += DISK_SECTOR_SIZE;
 		} else {
-			uint8_t *bounce = malloc (DISK_SECTOR_SIZE);
+			if (bounce == NULL)
+				bounce = scratch_alloc (DISK_SECTOR_SIZE);
 			if (bounce == NULL)
 				PANIC ("FAT load failed");
 			disk_read (filesys_disk, fat_fs->bs.fat_start + i, bounce);
 			memcpy (buffer + bytes_read, bounce, bytes_left);
 			bytes_read += bytes_left;
-			free (bounce);
 		}
 	}
+	scratch_release (mark);
 }
 
 void
 fat_close (void) {
 	// Write FAT boot sector
-	uint8_t *bounce = calloc (1, DISK_SECTOR_SIZE);
+	size_t mark = scratch_mark ();
+	uint8_t *bounce = scratch_alloc (DISK_SECTOR_SIZE);
 	if (bounce == NULL)
 		PANIC ("FAT close failed");
+	memset (bounce, 0, DISK_SECTOR_SIZE);
 	memcpy (bounce, &fat_fs->bs, sizeof (fat_fs->bs));
 	disk_write (filesys_disk, FAT_BOOT_SECTOR, bounce);
-	free (bounce);
 
 	// Write FAT directly to the disk
 	uint8_t *buffer = (uint8_t *) fat_fs->fat;
@@ -102,15 +108,13 @@ fat_close (void) {
 			            buffer + bytes_wrote);
 			bytes_wrote += DISK_SECTOR_SIZE;
 		} else {
-			bounce = calloc (1, DISK_SECTOR_SIZE);
-			if (bounce == NULL)
-				PANIC ("FAT close failed");
+			memset (bounce, 0, DISK_SECTOR_SIZE);
 			memcpy (bounce, buffer + bytes_wrote, bytes_left);
 			disk_write (filesys_disk, fat_fs->bs.fat_start + i, bounce);
 			bytes_wrote += bytes_left;
-			free (bounce);
 		}
 	}
+	scratch_release (mark);
 }
 
 void
@@ -128,11 +132,13 @@ fat_create (void) {
 	fat_put (ROOT_DIR_CLUSTER, EOChain);
 
 	// Fill up ROOT_DIR_CLUSTER region with 0
-	uint8_t *buf = calloc (1, DISK_SECTOR_SIZE);
+	size_t mark = scratch_mark ();
+	uint8_t *buf = scratch_alloc (DISK_SECTOR_SIZE);
 	if (buf == NULL)
 		PANIC ("FAT create failed due to OOM");
+	memset (buf, 0, DISK_SECTOR_SIZE);
 	disk_write (filesys_disk, cluster_to_sector (ROOT_DIR_CLUSTER), buf);
-	free (buf);
+	scratch_release (mark);
 }
 
 void
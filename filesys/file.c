@@ -2,6 +2,9 @@
 #include <debug.h>
 #include "filesys/inode.h"
 #include "threads/malloc.h"
+#ifdef VM
+#include "filesys/page_cache.h"
+#endif
 
 /* An open file. */
 struct file {
@@ -64,6 +67,27 @@ file_get_inode (struct file *file) {
 	return file->inode;
 }
 
+/* Reads from or writes to INODE.  With virtual memory, file pages
+ * may be mapped into memory, and the page cache keeps read() and
+ * write() consistent with the mappings. */
+static off_t
+read_at (struct inode *inode, void *buffer, off_t size, off_t ofs) {
+#ifdef VM
+	return page_cache_read (inode, buffer, size, ofs);
+#else
+	return inode_read_at (inode, buffer, size, ofs);
+#endif
+}
+
+static off_t
+write_at (struct inode *inode, const void *buffer, off_t size, off_t ofs) {
+#ifdef VM
+	return page_cache_write (inode, buffer, size, ofs);
+#else
+	return inode_write_at (inode, buffer, size, ofs);
+#endif
+}
+
 /* Reads SIZE bytes from FILE into BUFFER,
  * starting at the file's current position.
  * Returns the number of bytes actually read,
@@ -71,7 +95,7 @@ file_get_inode (struct file *file) {
  * Advances FILE's position by the number of bytes read. */
 off_t
 file_read (struct file *file, void *buffer, off_t size) {
-	off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+	off_t bytes_read = read_at (file->inode, buffer, size, file->pos);
 	file->pos += bytes_read;
 	return bytes_read;
 }
@@ -83,7 +107,7 @@ file_read (struct file *file, void *buffer, off_t size) {
  * The file's current position is unaffected. */
 off_t
 file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs) {
-	return inode_read_at (file->inode, buffer, size, file_ofs);
+	return read_at (file->inode, buffer, size, file_ofs);
 }
 
 /* Writes SIZE bytes from BUFFER into FILE,
@@ -95,7 +119,7 @@ file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs) {
  * Advances FILE's position by the number of bytes read. */
 off_t
 file_write (struct file *file, const void *buffer, off_t size) {
-	off_t bytes_written = inode_write_at (file->inode, buffer, size, file->pos);
+	off_t bytes_written = write_at (file->inode, buffer, size, file->pos);
 	file->pos += bytes_written;
 	return bytes_written;
 }
@@ -110,7 +134,7 @@ file_write (struct file *file, const void *buffer, off_t size) {
 off_t
 file_write_at (struct file *file, const void *buffer, off_t size,
 		off_t file_ofs) {
-	return inode_write_at (file->inode, buffer, size, file_ofs);
+	return write_at (file->inode, buffer, size, file_ofs);
 }
 
 /* Prevents write operations on FILE's underlying inode
@@ -6,6 +6,7 @@
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#include "threads/scratch.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
@@ -33,6 +34,7 @@ struct inode {
 	int open_cnt;                       /* Number of openers. */
 	bool removed;                       /* True if deleted, false otherwise. */
 	int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+	int write_map_cnt;                  /* Writable shared mappings. */
 	struct inode_disk data;             /* Inode content. */
 };
 
@@ -115,15 +117,17 @@ inode_open (disk_sector_t sector) {
 	}
 
 	/* Allocate memory. */
-	inode = malloc (sizeof *inode);
+	inode = malloc_tagged (sizeof *inode, MEM_INODE);
 	if (inode == NULL)
 		return NULL;
+	malloc_disown (inode);
 
 	/* Initialize. */
 	list_push_front (&open_inodes, &inode->elem);
 	inode->sector = sector;
 	inode->open_cnt = 1;
 	inode->deny_write_cnt = 0;
+	inode->write_map_cnt = 0;
 	inode->removed = false;
 	disk_read (filesys_disk, inode->sector, &inode->data);
 	return inode;
@@ -184,6 +188,7 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 	uint8_t *buffer = buffer_;
 	off_t bytes_read = 0;
 	uint8_t *bounce = NULL;
+	size_t mark = scratch_mark ();
 
 	while (size > 0) {
 		/* Disk sector to read, starting byte offset within sector. */
@@ -207,7 +212,7 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 			/* Read sector into bounce buffer, then partially copy
 			 * into caller's buffer. */
 			if (bounce == NULL) {
-				bounce = malloc (DISK_SECTOR_SIZE);
+				bounce = scratch_alloc (DISK_SECTOR_SIZE);
 				if (bounce == NULL)
 					break;
 			}
@@ -220,7 +225,7 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 		offset += chunk_size;
 		bytes_read += chunk_size;
 	}
-	free (bounce);
+	scratch_release (mark);
 
 	return bytes_read;
 }
@@ -236,10 +241,12 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 	const uint8_t *buffer = buffer_;
 	off_t bytes_written = 0;
 	uint8_t *bounce = NULL;
+	size_t mark;
 
 	if (inode->deny_write_cnt)
 		return 0;
 
+	mark = scratch_mark ();
 	while (size > 0) {
 		/* Sector to write, starting byte offset within sector. */
 		disk_sector_t sector_idx = byte_to_sector (inode, offset);
@@ -261,7 +268,7 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 		} else {
 			/* We need a bounce buffer. */
 			if (bounce == NULL) {
-				bounce = malloc (DISK_SECTOR_SIZE);
+				bounce = scratch_alloc (DISK_SECTOR_SIZE);
 				if (bounce == NULL)
 					break;
 			}
@@ -282,7 +289,7 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 		offset += chunk_size;
 		bytes_written += chunk_size;
 	}
-	free (bounce);
+	scratch_release (mark);
 
 	return bytes_written;
 }
@@ -306,6 +313,34 @@ inode_allow_write (struct inode *inode) {
 	inode->deny_write_cnt--;
 }
 
+/* Returns true if writes to INODE are denied. */
+bool
+inode_is_write_denied (const struct inode *inode) {
+	return inode->deny_write_cnt > 0;
+}
+
+/* Records that a writable shared mapping of INODE was made, or, with
+   inode_unmap_writable(), dropped.  Each must be made by an opener
+   of INODE. */
+void
+inode_map_writable (struct inode *inode) {
+	ASSERT (inode->write_map_cnt < inode->open_cnt);
+	inode->write_map_cnt++;
+}
+
+void
+inode_unmap_writable (struct inode *inode) {
+	ASSERT (inode->write_map_cnt > 0);
+	inode->write_map_cnt--;
+}
+
+/* Returns true if INODE has writable shared mappings, which can
+   change its contents without going through inode_write_at(). */
+bool
+inode_is_mapped_writable (const struct inode *inode) {
+	return inode->write_map_cnt > 0;
+}
+
 /* Returns the length, in bytes, of INODE's data. */
 off_t
 inode_length (const struct inode *inode) {
@@ -48,3 +48,346 @@ page_cache_destroy (struct page *page) {
 static void
 page_cache_kworkerd (void *aux) {
 }
+
+#ifdef VM
+/* The page cache of file pages mapped into memory.
+
+   Every page of a file that is mapped by some process is held in
+   one frame, found here by (inode, offset), and mapped by all of
+   them, so they see each other's stores; read() and write() on
+   the file go through the same frame.  A cached page lives while
+   it is mapped: when the last mapping goes away, or when the VM
+   layer evicts the frame, it is written back if any mapping
+   dirtied it and dropped.
+
+   CACHE_LOCK protects the table and each entry's STATE, USERS and
+   FRAME.  A lookup that finds an entry being loaded or evicted
+   waits for that to finish. */
+
+#include <stdio.h>
+#include <string.h>
+#include "filesys/inode.h"
+#include "filesys/page_cache.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+static struct hash cache;
+static struct lock cache_lock;
+static struct condition cache_cond;    /* Some entry left a transient state. */
+
+static unsigned long long hit_cnt, miss_cnt, writeback_cnt;
+static unsigned long long sync_cnt;    /* Written back while mapped. */
+static unsigned long long io_hit_cnt;  /* read()/write() pages served here. */
+
+static uint64_t
+cache_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct cached_page *cp = hash_entry (e, struct cached_page, elem);
+	return hash_bytes (&cp->inode, sizeof cp->inode) ^ hash_int (cp->ofs);
+}
+
+static bool
+cache_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	const struct cached_page *a = hash_entry (a_, struct cached_page, elem);
+	const struct cached_page *b = hash_entry (b_, struct cached_page, elem);
+	if (a->inode != b->inode)
+		return a->inode < b->inode;
+	return a->ofs < b->ofs;
+}
+
+void
+page_cache_init (void) {
+	hash_init (&cache, cache_hash, cache_less, NULL);
+	lock_init (&cache_lock);
+	cond_init (&cache_cond);
+}
+
+/* Returns the entry for page OFS of INODE, waiting out any load or
+ * eviction in progress, or NULL if it is not cached.  Must be
+ * called with CACHE_LOCK held. */
+static struct cached_page *
+lookup (struct inode *inode, off_t ofs) {
+	struct cached_page key, *cp;
+	struct hash_elem *e;
+
+	key.inode = inode;
+	key.ofs = ofs;
+	for (;;) {
+		e = hash_find (&cache, &key.elem);
+		if (e == NULL)
+			return NULL;
+		cp = hash_entry (e, struct cached_page, elem);
+		if (cp->state == PC_READY)
+			return cp;
+		cond_wait (&cache_cond, &cache_lock);
+	}
+}
+
+/* Returns the entry for page OFS of INODE, which must be
+ * page-aligned, creating it if need be, and holds it against
+ * eviction until page_cache_put().  If the entry has no FRAME,
+ * the caller just created it and must load it with
+ * page_cache_fill().  Returns NULL if memory is short. */
+struct cached_page *
+page_cache_get (struct inode *inode, off_t ofs) {
+	struct cached_page *cp;
+	off_t left;
+
+	ASSERT (pg_ofs (ofs) == 0);
+
+	lock_acquire (&cache_lock);
+	cp = lookup (inode, ofs);
+	if (cp != NULL) {
+		cp->users++;
+		hit_cnt++;
+		lock_release (&cache_lock);
+		return cp;
+	}
+
+	cp = malloc_tagged (sizeof *cp, MEM_FRAME);
+	if (cp != NULL) {
+		malloc_disown (cp);
+		left = inode_length (inode) - ofs;
+		cp->inode = inode;
+		cp->ofs = ofs;
+		cp->bytes = left <= 0 ? 0 : left < PGSIZE ? (size_t) left : PGSIZE;
+		cp->state = PC_LOADING;
+		cp->users = 1;
+		cp->frame = NULL;
+		list_init (&cp->mappers);
+		cp->dirty = false;
+		hash_insert (&cache, &cp->elem);
+		miss_cnt++;
+	}
+	lock_release (&cache_lock);
+	return cp;
+}
+
+/* Loads CP, just created by page_cache_get(), into FRAME: copies
+ * CP->BYTES from DATA if it is nonnull, else reads the file.
+ * Returns true if successful.  Otherwise CP is dropped and must
+ * not be used again. */
+bool
+page_cache_fill (struct cached_page *cp, struct frame *frame,
+		const void *data) {
+	bool ok = true;
+
+	ASSERT (cp->state == PC_LOADING && cp->frame == NULL);
+
+	if (data != NULL)
+		memcpy (frame->kva, data, cp->bytes);
+	else
+		ok = inode_read_at (cp->inode, frame->kva, cp->bytes, cp->ofs)
+			== (off_t) cp->bytes;
+	memset ((uint8_t *) frame->kva + cp->bytes, 0, PGSIZE - cp->bytes);
+
+	lock_acquire (&cache_lock);
+	if (ok) {
+		cp->frame = frame;
+		cp->state = PC_READY;
+	} else
+		hash_delete (&cache, &cp->elem);
+	cond_broadcast (&cache_cond, &cache_lock);
+	lock_release (&cache_lock);
+	if (!ok)
+		free (cp);
+	return ok;
+}
+
+/* Releases the hold on CP taken by page_cache_get(). */
+void
+page_cache_put (struct cached_page *cp) {
+	lock_acquire (&cache_lock);
+	ASSERT (cp->users > 0);
+	cp->users--;
+	lock_release (&cache_lock);
+}
+
+/* Holds CP against eviction, like page_cache_get(), if it is
+ * ready; returns false if it is being loaded or evicted.  Never
+ * waits, so it may be called with the VM frame lock held. */
+bool
+page_cache_hold (struct cached_page *cp) {
+	bool ok;
+
+	lock_acquire (&cache_lock);
+	ok = cp->state == PC_READY;
+	if (ok)
+		cp->users++;
+	lock_release (&cache_lock);
+	return ok;
+}
+
+/* Returns true if page OFS of INODE is cached or being loaded.
+ * The answer may be stale by the time it is used. */
+bool
+page_cache_contains (struct inode *inode, off_t ofs) {
+	struct cached_page key;
+	bool found;
+
+	key.inode = inode;
+	key.ofs = ofs;
+	lock_acquire (&cache_lock);
+	found = hash_find (&cache, &key.elem) != NULL;
+	lock_release (&cache_lock);
+	return found;
+}
+
+/* Starts evicting CP.  Returns false, doing nothing, if it is in
+ * use or already on its way out. */
+bool
+page_cache_evict_begin (struct cached_page *cp) {
+	bool ok;
+
+	lock_acquire (&cache_lock);
+	ok = cp->state == PC_READY && cp->users == 0;
+	if (ok)
+		cp->state = PC_EVICTING;
+	lock_release (&cache_lock);
+	return ok;
+}
+
+/* Finishes the eviction of CP.  If EVICTED, CP, which must have
+ * been written back and have no mappers, is dropped; otherwise it
+ * stays cached. */
+void
+page_cache_evict_end (struct cached_page *cp, bool evicted) {
+	lock_acquire (&cache_lock);
+	ASSERT (cp->state == PC_EVICTING);
+	if (evicted)
+		hash_delete (&cache, &cp->elem);
+	else
+		cp->state = PC_READY;
+	cond_broadcast (&cache_cond, &cache_lock);
+	lock_release (&cache_lock);
+	if (evicted)
+		free (cp);
+}
+
+/* Writes CP, which is being evicted, back to its file. */
+void
+page_cache_write_back (struct cached_page *cp) {
+	ASSERT (cp->state == PC_EVICTING);
+	inode_write_at (cp->inode, cp->frame->kva, cp->bytes, cp->ofs);
+	writeback_cnt++;
+}
+
+/* Writes CP, which the caller holds, back to its file while it
+ * stays cached and mapped.  Stores made during the write may or
+ * may not reach the file; the caller must have cleared the dirty
+ * bits first, so that they are noticed later. */
+void
+page_cache_sync (struct cached_page *cp) {
+	ASSERT (cp->state == PC_READY && cp->users > 0);
+	inode_write_at (cp->inode, cp->frame->kva, cp->bytes, cp->ofs);
+	sync_cnt++;
+}
+
+/* Returns the cached page OFS of INODE, held with page_cache_get()
+ * semantics, or NULL if it is not cached. */
+static struct cached_page *
+find_held (struct inode *inode, off_t ofs) {
+	struct cached_page *cp;
+
+	if (hash_empty (&cache))
+		return NULL;
+	lock_acquire (&cache_lock);
+	cp = lookup (inode, ofs);
+	if (cp != NULL)
+		cp->users++;
+	lock_release (&cache_lock);
+	return cp;
+}
+
+/* Reads SIZE bytes from INODE at OFS into BUFFER, taking pages
+ * that are cached from the cache and the rest from the disk.
+ * Returns the number of bytes read, as inode_read_at() does. */
+off_t
+page_cache_read (struct inode *inode, void *buffer_, off_t size, off_t ofs) {
+	uint8_t *buffer = buffer_;
+	off_t bytes_read = 0;
+
+	while (size > 0) {
+		struct cached_page *cp = NULL;
+		off_t run = 0, n;
+
+		/* Read up to the next cached page from the disk. */
+		while (run < size
+				&& (cp = find_held (inode, ofs + run - pg_ofs (ofs + run))) == NULL)
+			run += PGSIZE - pg_ofs (ofs + run);
+		if (run > size)
+			run = size;
+		if (run > 0) {
+			n = inode_read_at (inode, buffer, run, ofs);
+			bytes_read += n;
+			if (n < run) {
+				if (cp != NULL)
+					page_cache_put (cp);
+				break;
+			}
+			buffer += n;
+			ofs += n;
+			size -= n;
+		}
+		if (cp == NULL)
+			break;
+
+		/* Copy the cached page, up to the end of the file. */
+		n = PGSIZE - pg_ofs (ofs);
+		if (n > size)
+			n = size;
+		if (n > inode_length (inode) - ofs)
+			n = inode_length (inode) - ofs;
+		if (n > 0)
+			memcpy (buffer, (uint8_t *) cp->frame->kva + pg_ofs (ofs), n);
+		page_cache_put (cp);
+		io_hit_cnt++;
+		if (n <= 0)
+			break;
+		bytes_read += n;
+		buffer += n;
+		ofs += n;
+		size -= n;
+	}
+	return bytes_read;
+}
+
+/* Writes SIZE bytes from BUFFER to INODE at OFS, and into any of
+ * the pages that are cached, so that mappings of the file see the
+ * new data.  Returns the number of bytes written, as
+ * inode_write_at() does. */
+off_t
+page_cache_write (struct inode *inode, const void *buffer_, off_t size,
+		off_t ofs) {
+	const uint8_t *buffer = buffer_;
+	off_t bytes_written = inode_write_at (inode, buffer, size, ofs);
+
+	for (off_t done = 0; done < bytes_written; ) {
+		off_t pos = ofs + done;
+		off_t n = PGSIZE - pg_ofs (pos);
+		struct cached_page *cp = find_held (inode, pos - pg_ofs (pos));
+
+		if (n > bytes_written - done)
+			n = bytes_written - done;
+		if (cp != NULL) {
+			memcpy ((uint8_t *) cp->frame->kva + pg_ofs (pos), buffer + done, n);
+			page_cache_put (cp);
+			io_hit_cnt++;
+		}
+		done += n;
+	}
+	return bytes_written;
+}
+
+/* Prints page cache statistics. */
+void
+page_cache_print_stats (void) {
+	if (hit_cnt + miss_cnt == 0)
+		return;
+	printf ("Page cache: %zu pages, %llu hits, %llu misses, "
+			"%llu written back, %llu synced, %llu read/write pages served\n",
+			hash_size (&cache), hit_cnt, miss_cnt, writeback_cnt, sync_cnt,
+			io_hit_cnt);
+}
+#endif /* VM */
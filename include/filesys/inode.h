@@ -18,6 +18,10 @@ off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
+bool inode_is_write_denied (const struct inode *);
+void inode_map_writable (struct inode *);
+void inode_unmap_writable (struct inode *);
+bool inode_is_mapped_writable (const struct inode *);
 off_t inode_length (const struct inode *);
 
 #endif /* filesys/inode.h */
@@ -9,4 +9,47 @@ struct page_cache {};
 
 void page_cache_init (void);
 bool page_cache_initializer (struct page *page, enum vm_type type, void *kva);
+
+#ifdef VM
+#include <hash.h>
+#include <list.h>
+#include "filesys/off_t.h"
+
+struct inode;
+struct frame;
+
+/* A page of a file held in memory, shared by every mapping of that
+ * page and by read() and write() on the file. */
+struct cached_page {
+	struct hash_elem elem;      /* In the cache. */
+	struct inode *inode;
+	off_t ofs;                  /* Page-aligned offset in INODE. */
+	size_t bytes;               /* Bytes of file data; the rest are 0. */
+	enum cached_state {
+		PC_LOADING,             /* Being read in. */
+		PC_READY,               /* FRAME holds the data. */
+		PC_EVICTING,            /* Being written back and dropped. */
+	} state;
+	unsigned users;             /* Lookups in progress; pins the entry. */
+	struct frame *frame;        /* Frame holding the data, once READY. */
+
+	/* Protected by the VM frame lock. */
+	struct list mappers;        /* Pages mapping it, by file.pc_elem. */
+	bool dirty;                 /* Written since last written back, through
+	                               a mapping whose dirty bit was taken. */
+};
+
+struct cached_page *page_cache_get (struct inode *, off_t ofs);
+bool page_cache_fill (struct cached_page *, struct frame *, const void *data);
+void page_cache_put (struct cached_page *);
+bool page_cache_hold (struct cached_page *);
+void page_cache_sync (struct cached_page *);
+bool page_cache_contains (struct inode *, off_t ofs);
+bool page_cache_evict_begin (struct cached_page *);
+void page_cache_evict_end (struct cached_page *, bool evicted);
+void page_cache_write_back (struct cached_page *);
+off_t page_cache_read (struct inode *, void *, off_t size, off_t ofs);
+off_t page_cache_write (struct inode *, const void *, off_t size, off_t ofs);
+void page_cache_print_stats (void);
+#endif /* VM */
 #endif
@@ -36,6 +36,36 @@ enum {
 
 	SYS_MOUNT,
 	SYS_UMOUNT,
+
+	/* Virtual memory extensions. */
+	SYS_MADVISE,                /* Advise on use of a memory range. */
+	SYS_MSYNC,                  /* Write back a file mapping. */
+	SYS_SET_RSS_LIMIT,          /* Limit the resident set size. */
+	SYS_BRK,                    /* Set the end of the heap. */
+	SYS_SBRK,                   /* Grow or shrink the heap. */
+};
+
+/* Advice for SYS_MADVISE. */
+enum {
+	MADV_NORMAL,                /* No special treatment. */
+	MADV_RANDOM,                /* Expect random access: no read-ahead. */
+	MADV_SEQUENTIAL,            /* Expect sequential access. */
+	MADV_WILLNEED,              /* Load the range now. */
+	MADV_DONTNEED,              /* Drop the range's contents now. */
+	MADV_COLD,                  /* Evict the range before other pages. */
+};
+
+/* Flags for SYS_MMAP, or'd into its WRITABLE argument. */
+enum {
+	MAP_ANONYMOUS = 0x100,      /* Zero-filled memory; FD and OFFSET unused. */
+	MAP_POPULATE = 0x200,       /* Load every page before returning. */
+};
+
+/* Flags for SYS_MSYNC. */
+enum {
+	MS_ASYNC = 1,               /* Schedule the write-back. */
+	MS_INVALIDATE = 2,          /* Accepted; mappings are always coherent. */
+	MS_SYNC = 4,                /* Write back before returning. */
 };
 
 #endif /* lib/syscall-nr.h */
@@ -2,7 +2,9 @@
 #define THREADS_MALLOC_H
 
 #include <debug.h>
+#include <stdbool.h>
 #include <stddef.h>
+#include "threads/palloc.h"
 
 void malloc_init (void);
 void *malloc (size_t) __attribute__ ((malloc));
@@ -10,4 +12,13 @@ void *calloc (size_t, size_t) __attribute__ ((malloc));
 void *realloc (void *, size_t);
 void free (void *);
 
+void *malloc_tagged (size_t, enum mem_tag) __attribute__ ((malloc));
+void *calloc_tagged (size_t, size_t, enum mem_tag) __attribute__ ((malloc));
+void malloc_print_stats (void);
+
+/* -memleak: record the owner of every block. */
+extern bool malloc_leak_check;
+void malloc_leak_report (int tid);
+void malloc_disown (void *);
+
 #endif /* threads/malloc.h */
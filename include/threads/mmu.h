@@ -2,9 +2,13 @@
 #define THREAD_MMU_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include "threads/pte.h"
 
+/* -nopcid: do not tag TLB entries with process-context IDs? */
+extern bool pcid_disabled;
+
 typedef bool pte_for_each_func (uint64_t *pte, void *va, void *aux);
 
 uint64_t *pml4e_walk (uint64_t *pml4, const uint64_t va, int create);
@@ -12,17 +16,33 @@ uint64_t *pml4_create (void);
 bool pml4_for_each (uint64_t *, pte_for_each_func *, void *);
 void pml4_destroy (uint64_t *pml4);
 void pml4_activate (uint64_t *pml4);
+void pml4_pcid_init (void);
+void pml4_print_stats (void);
 void *pml4_get_page (uint64_t *pml4, const void *upage);
 bool pml4_set_page (uint64_t *pml4, void *upage, void *kpage, bool rw);
+bool pml4_set_large_page (uint64_t *pml4, uint64_t va, uint64_t pa,
+		uint64_t flags);
+bool pml4_split_large_page (uint64_t *pml4, uint64_t va);
 void pml4_clear_page (uint64_t *pml4, void *upage);
 bool pml4_is_dirty (uint64_t *pml4, const void *upage);
 void pml4_set_dirty (uint64_t *pml4, const void *upage, bool dirty);
 bool pml4_is_accessed (uint64_t *pml4, const void *upage);
 void pml4_set_accessed (uint64_t *pml4, const void *upage, bool accessed);
 
+bool pml4_map_range (uint64_t *pml4, void *upage, void **kpages, size_t cnt,
+		bool rw);
+void pml4_clear_range (uint64_t *pml4, void *start, void *end);
+void pml4_unmap_range (uint64_t *pml4, void *start, void *end);
+void pml4_protect_range (uint64_t *pml4, void *start, void *end, bool rw);
+bool pml4_is_dirty_range (uint64_t *pml4, const void *start, const void *end,
+		bool clear);
+bool pml4_for_each_range (uint64_t *pml4, const void *start, const void *end,
+		pte_for_each_func *, void *);
+
 #define is_writable(pte) (*(pte) & PTE_W)
 #define is_user_pte(pte) (*(pte) & PTE_U)
 #define is_kern_pte(pte) (!is_user_pte (pte))
+#define is_large_pte(pte) (*(pte) & PTE_PS)
 
 #define pte_get_paddr(pte) (pg_round_down(*(pte)))
 
@@ -4,6 +4,23 @@
 #include <stdint.h>
 #include <stddef.h>
 
+/* Owners of kernel memory, for accounting.  Each page handed out
+   by palloc and each block handed out by malloc is charged to one
+   tag; see palloc_print_stats() and malloc_print_stats(). */
+enum mem_tag {
+	MEM_MISC,                   /* Untagged allocations. */
+	MEM_ARENA,                  /* malloc() arenas (pages only). */
+	MEM_THREAD,                 /* struct thread and kernel stack. */
+	MEM_PGTBL,                  /* Page-map-level-4 and lower tables. */
+	MEM_USER,                   /* User frames. */
+	MEM_SPT,                    /* Supplemental page table entries. */
+	MEM_FRAME,                  /* Frame table entries. */
+	MEM_INODE,                  /* In-memory inodes. */
+	MEM_SWAP,                   /* Swap slot bookkeeping. */
+	MEM_SCRATCH,                /* Per-thread scratch arenas. */
+	MEM_TAG_CNT
+};
+
 /* How to allocate pages. */
 enum palloc_flags {
 	PAL_ASSERT = 001,           /* Panic on failure. */
@@ -11,13 +28,34 @@ enum palloc_flags {
 	PAL_USER = 004              /* User page. */
 };
 
+/* Charges the pages to TAG.  Untagged requests are charged to
+   MEM_USER if PAL_USER is set, MEM_MISC otherwise. */
+#define PAL_TAG_SHIFT 8
+#define PAL_TAG(TAG) ((TAG) << PAL_TAG_SHIFT)
+
+/* Usage of one tag. */
+struct mem_usage {
+	size_t live;                /* Bytes currently allocated. */
+	size_t peak;                /* High-water mark of LIVE. */
+	unsigned long long allocs;  /* Number of allocations. */
+	unsigned long long frees;   /* Number of frees. */
+};
+
 /* Maximum number of pages to put in user pool. */
 extern size_t user_page_limit;
 
 uint64_t palloc_init (void);
 void *palloc_get_page (enum palloc_flags);
 void *palloc_get_multiple (enum palloc_flags, size_t page_cnt);
+void *palloc_get_aligned (enum palloc_flags, size_t page_cnt, size_t align);
 void palloc_free_page (void *);
 void palloc_free_multiple (void *, size_t page_cnt);
+size_t palloc_free_cnt (enum palloc_flags);
+enum mem_tag palloc_page_tag (const void *);
+void palloc_print_stats (void);
+
+const char *mem_tag_name (enum mem_tag);
+void mem_usage_charge (struct mem_usage *, size_t bytes);
+void mem_usage_uncharge (struct mem_usage *, size_t bytes);
 
 #endif /* threads/palloc.h */
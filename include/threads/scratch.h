@@ -0,0 +1,18 @@
+#ifndef THREADS_SCRATCH_H
+#define THREADS_SCRATCH_H
+
+#include <stddef.h>
+
+struct thread;
+
+/* Size of each thread's scratch arena. */
+#define SCRATCH_SIZE (2 * 4096)
+
+void *scratch_alloc (size_t size);
+void scratch_trim (void *block, size_t size);
+size_t scratch_mark (void);
+void scratch_release (size_t mark);
+void scratch_reset (void);
+void scratch_destroy (struct thread *);
+
+#endif /* threads/scratch.h */
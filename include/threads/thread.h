@@ -103,6 +103,10 @@ struct thread {
   /* Shared between thread.c and synch.c. */
   struct list_elem elem; /* List element. */
 
+  /* Owned by threads/scratch.c. */
+  uint8_t *scratch;   /* Scratch arena, allocated on first use. */
+  size_t scratch_top; /* Bytes of the arena in use. */
+
 #ifdef USERPROG
   /* Owned by userprog/process.c. */
   uint64_t *pml4; /* Page map level 4 */
@@ -118,9 +122,9 @@ struct thread {
 #ifdef VM
   /* Table for whole virtual memory owned by thread. */
   struct supplemental_page_table spt;
-
-	/* Memory-mapped file regions (mmap/munmap). */
-	struct list mmap_list;
+  struct vm_fault_stats faults; /* Page faults taken, for -pfstat. */
+  size_t rss;                   /* Pages in private frames, by FRAME_LOCK. */
+  size_t rss_limit;             /* Most RSS before local eviction; 0: none. */
 #endif
 
   /* Owned by thread.c. */
@@ -3,16 +3,24 @@
 
 #include <stddef.h>
 #include <stdbool.h>
+#include "vm/zswap.h"
 
 struct page;
+struct supplemental_page_table;
 enum vm_type;
 
 struct anon_page {
 	/* Swap slot index when swapped out, BITMAP_ERROR when in memory. */
 	size_t slot;
+	/* Compressed copy when swapped out to zswap instead. */
+	struct zswap_handle zswap;
 };
 
 void vm_anon_init (void);
+bool anon_swap_add (int chan, int dev, int prio);
 bool anon_initializer (struct page *page, enum vm_type type, void *kva);
+bool anon_read_swapped (struct page *page, void *kva);
+size_t anon_release_swap (struct supplemental_page_table *spt);
+void vm_anon_print_stats (void);
 
 #endif /* VM_ANON_H */
@@ -31,6 +31,7 @@ enum vm_type {
 #include "vm/uninit.h"
 #include "vm/anon.h"
 #include "vm/file.h"
+#include "vm/vma.h"
 #ifdef EFILESYS
 #include "filesys/page_cache.h"
 #endif
@@ -54,6 +55,8 @@ struct page {
 	struct thread *owner;  /* Owning thread (for pml4 bits) */
 	struct hash_elem spt_elem;
 	bool writable;
+	bool zero;             /* Mapped read-only to the shared zero frame. */
+	uint64_t evicted_at;   /* Eviction clock when last paged out, or 0. */
 
 	/* Per-type data are binded into the union.
 	 * Each function automatically detects the current union */
@@ -72,8 +75,34 @@ struct frame {
 	void *kva;
 	struct page *page;
 	struct list_elem elem;
+	struct list_elem free_elem; /* In the free list while PAGE is NULL. */
+	struct list_elem lru_elem;  /* In an LRU list per LRU. */
+	enum frame_lru { LRU_NONE, LRU_ACTIVE, LRU_INACTIVE } lru;
+	bool huge;             /* 2 MB huge page; PAGE is its first page. */
+	unsigned pinned;       /* Pins held: being loaded, used by the kernel
+	                          or paged out; not evictable while nonzero. */
+	bool ksm;              /* Shared by KSM_REFS pages; PAGE is NULL. */
+	size_t ksm_refs;
+	uint64_t ksm_sum;      /* Checksum of contents at last KSM scan. */
+	struct hash_elem ksm_elem; /* In the KSM stable table if KSM. */
+	struct cached_page *pc;    /* Page cache entry held, or NULL; then
+	                              PAGE is NULL. */
+	bool writeback;            /* In the write-back list, if PC. */
+	struct list_elem wb_elem;  /* In the write-back list. */
+	struct thread *rss_owner;  /* Charged for it while on an LRU list. */
 };
 
+/* Returns the kernel virtual address of PAGE's contents, which
+ * must be resident.  A huge frame backs 512 consecutive pages. */
+static inline void *
+page_kva (const struct page *page) {
+	struct frame *frame = page->frame;
+	if (frame->huge)
+		return (uint8_t *) frame->kva
+			+ ((uint8_t *) page->va - (uint8_t *) frame->page->va);
+	return frame->kva;
+}
+
 /* The function table for page operations.
  * This is one way of implementing "interface" in C.
  * Put the table of "method" into the struct's member, and
@@ -95,6 +124,9 @@ struct page_operations {
  * All designs up to you for this. */
 struct supplemental_page_table {
 	struct hash page_map;
+	struct vma *vmas;      /* Root of the region tree. */
+	uint8_t *heap_start;   /* Start of the heap, past the image. */
+	uint8_t *brk;          /* End of the heap; see vm_brk(). */
 };
 
 struct segment_aux {
@@ -102,6 +134,26 @@ struct segment_aux {
 	off_t ofs;
 	size_t read_bytes;
 	size_t zero_bytes;
+	const void *data;      /* READ_BYTES already read from FILE, or NULL. */
+};
+
+/* Kinds of page faults handled by vm_try_handle_fault(). */
+enum vm_fault_kind {
+	VM_FAULT_MINOR,     /* No I/O: zero-filled or already in memory. */
+	VM_FAULT_FILE,      /* Read from a file. */
+	VM_FAULT_SWAP,      /* Read back from swap or zswap. */
+	VM_FAULT_STACK,     /* Grew the stack. */
+	VM_FAULT_COW,       /* Write to a shared read-only frame. */
+	VM_FAULT_KIND_CNT
+};
+
+/* Log2 buckets of fault handling time, in TSC cycles. */
+#define VM_FAULT_HIST_CNT 32
+
+/* Page faults taken by a process. */
+struct vm_fault_stats {
+	uint32_t cnt[VM_FAULT_KIND_CNT];
+	uint32_t hist[VM_FAULT_HIST_CNT];  /* Bucket I: [2**I, 2**(I+1)). */
 };
 
 #include "threads/thread.h"
@@ -111,12 +163,30 @@ bool supplemental_page_table_copy (struct supplemental_page_table *dst,
 void supplemental_page_table_kill (struct supplemental_page_table *spt);
 struct page *spt_find_page (struct supplemental_page_table *spt,
 		void *va);
+struct page *spt_lookup_page (struct supplemental_page_table *spt,
+		void *va);
 bool spt_insert_page (struct supplemental_page_table *spt, struct page *page);
 void spt_remove_page (struct supplemental_page_table *spt, struct page *page);
 
+/* -thp: back aligned anonymous regions with huge pages? */
+extern bool vm_thp_enabled;
+/* -ksm=PAGES: frames for ksmd to scan every 100 ms, 0 to disable. */
+extern size_t vm_ksm_scan_rate;
+/* -pfstat: report each process's page faults when it exits? */
+extern bool vm_fault_report;
+/* -rss=PAGES: resident-set limit of the first process, 0 for none. */
+extern size_t vm_rss_limit;
+
+/* Smallest resident-set limit a process may set. */
+#define VM_RSS_LIMIT_MIN 16
+
 void vm_init (void);
+void vm_print_stats (void);
+void vm_split_huge_frame (struct frame *);
+void vm_frame_detach (struct page *);
 bool vm_try_handle_fault (struct intr_frame *f, void *addr, bool user,
 		bool write, bool not_present);
+void vm_print_faults (void);
 
 #define vm_alloc_page(type, upage, writable) \
 	vm_alloc_page_with_initializer ((type), (upage), (writable), NULL, NULL)
@@ -124,6 +194,15 @@ bool vm_alloc_page_with_initializer (enum vm_type type, void *upage,
 		bool writable, vm_initializer *init, void *aux);
 void vm_dealloc_page (struct page *page);
 bool vm_claim_page (void *va);
+bool vm_make_writable (void *va);
+bool vm_madvise (void *addr, size_t length, int advice);
+long vm_set_rss_limit (size_t pages);
+void vm_populate (void *start, void *end);
+bool vm_brk (void *addr);
+void *vm_sbrk (intptr_t increment);
+bool vm_msync (void *addr, size_t length, int flags);
+void *vm_pin_page (const void *va, bool write);
+void vm_unpin_page (const void *va);
 enum vm_type page_get_type (struct page *page);
 
 #endif  /* VM_VM_H */
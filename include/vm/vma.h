@@ -0,0 +1,44 @@
+#ifndef VM_VMA_H
+#define VM_VMA_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "filesys/off_t.h"
+#include "vm/vm.h"
+
+struct file;
+struct supplemental_page_table;
+
+/* A region of an address space: a run of pages with the same
+ * backing and protection.  The struct page for each page in a
+ * region is only created when the page is first looked up, so
+ * mapping a large region costs one allocation. */
+struct vma {
+	void *start;               /* First page, page-aligned. */
+	void *end;                 /* Past the last page. */
+	enum vm_type type;         /* VM_ANON or VM_FILE. */
+	bool writable;
+	vm_initializer *init;      /* Loads a page from FILE. */
+	struct file *file;         /* Backing file, owned by the region. */
+	off_t ofs;                 /* Offset in FILE of START. */
+	size_t read_bytes;         /* Bytes read from FILE; the rest are 0. */
+	void *ra_next;             /* Page past the last fault-around. */
+	size_t ra_pages;           /* Fault-around window, or 0 if unset. */
+	int advice;                /* MADV_NORMAL, _RANDOM or _SEQUENTIAL. */
+	bool mapped;               /* Made by mmap(), so munmap() may remove it. */
+
+	struct vma *left, *right;  /* Children in the region tree. */
+	int height;                /* Height of this subtree. */
+};
+
+struct vma *vma_add (struct supplemental_page_table *, const struct vma *);
+void vma_destroy (struct supplemental_page_table *, struct vma *);
+struct vma *vma_find (struct supplemental_page_table *, const void *va);
+struct vma *vma_next (struct supplemental_page_table *, const void *va);
+struct vma *vma_overlap (struct supplemental_page_table *,
+		const void *start, const void *end);
+bool vma_copy (struct supplemental_page_table *dst,
+		struct supplemental_page_table *src);
+void vma_kill (struct supplemental_page_table *);
+
+#endif /* VM_VMA_H */
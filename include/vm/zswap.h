@@ -0,0 +1,27 @@
+#ifndef VM_ZSWAP_H
+#define VM_ZSWAP_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+struct zpage;
+
+/* A page held compressed in the zswap pool.  ZPAGE is null when
+ * the handle holds nothing. */
+struct zswap_handle {
+	struct zpage *zpage;   /* Pool page holding the data. */
+	uint16_t idx;          /* Object index within ZPAGE. */
+	uint16_t len;          /* Compressed length in bytes. */
+};
+
+/* -zswap=PAGES: pool size limit; SIZE_MAX picks a default. */
+extern size_t zswap_max_pages;
+
+void zswap_init (void);
+bool zswap_store (const void *kva, struct zswap_handle *);
+bool zswap_load (const struct zswap_handle *, void *kva);
+void zswap_free (struct zswap_handle *);
+void zswap_print_stats (void);
+
+#endif /* VM_ZSWAP_H */
@@ -1,5 +1,32 @@
 #include <string.h>
 #include <debug.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* The bulk loops below move one machine word at a time.  x86-64
+   tolerates unaligned loads and stores, so only the destination
+   (or, for strlen(), the scanned string) is brought to word
+   alignment first.  may_alias lets us access any object through
+   a word_t without breaking the compiler's aliasing rules. */
+typedef uint64_t __attribute__ ((__may_alias__)) word_t;
+#define WORD_SIZE sizeof (word_t)
+#define WORD_MASK (WORD_SIZE - 1)
+
+/* A word with 0x01 (resp. 0x80) in every byte.  has_zero_byte(W)
+   is nonzero iff some byte of W is zero. */
+#define ONES ((word_t) 0x0101010101010101ULL)
+#define HIGHS ((word_t) 0x8080808080808080ULL)
+#define has_zero_byte(w) (((w) - ONES) & ~(w) & HIGHS)
+
+/* Requests of at least this many bytes go to `rep movsb' or
+   `rep stosb' on CPUs with Enhanced REP MOVSB/STOSB (ERMS), where
+   microcode moves whole cache lines.  Below it the startup cost
+   of the string instruction outweighs the gain. */
+#define ERMS_THRESHOLD 512
+
+static bool cpu_has_erms (void);
+static void copy_forward (unsigned char *, const unsigned char *, size_t);
+static void copy_backward (unsigned char *, const unsigned char *, size_t);
 
 /* Copies SIZE bytes from SRC to DST, which must not overlap.
    Returns DST. */
@@ -11,8 +38,11 @@ memcpy (void *dst_, const void *src_, size_t size) {
 	ASSERT (dst != NULL || size == 0);
 	ASSERT (src != NULL || size == 0);
 
-	while (size-- > 0)
-		*dst++ = *src++;
+	if (size >= ERMS_THRESHOLD && cpu_has_erms ())
+		asm volatile ("rep movsb"
+				: "+D" (dst), "+S" (src), "+c" (size) : : "memory");
+	else
+		copy_forward (dst, src, size);
 
 	return dst_;
 }
@@ -27,17 +57,14 @@ memmove (void *dst_, const void *src_, size_t size) {
 	ASSERT (dst != NULL || size == 0);
 	ASSERT (src != NULL || size == 0);
 
-	if (dst < src) {
-		while (size-- > 0)
-			*dst++ = *src++;
-	} else {
-		dst += size;
-		src += size;
-		while (size-- > 0)
-			*--dst = *--src;
-	}
+	if (dst + size <= src || src + size <= dst)
+		return memcpy (dst_, src_, size);
+	else if (dst < src)
+		copy_forward (dst, src, size);
+	else
+		copy_backward (dst, src, size);
 
-	return dst;
+	return dst_;
 }
 
 /* Find the first differing byte in the two blocks of SIZE bytes
@@ -52,6 +79,12 @@ memcmp (const void *a_, const void *b_, size_t size) {
 	ASSERT (a != NULL || size == 0);
 	ASSERT (b != NULL || size == 0);
 
+	/* Skip over equal words; the byte loop below locates the first
+	   difference inside the word that mismatched, if any. */
+	for (; size >= WORD_SIZE; size -= WORD_SIZE, a += WORD_SIZE, b += WORD_SIZE)
+		if (*(const word_t *) a != *(const word_t *) b)
+			break;
+
 	for (; size-- > 0; a++, b++)
 		if (*a != *b)
 			return *a > *b ? +1 : -1;
@@ -260,6 +293,25 @@ memset (void *dst_, int value, size_t size) {
 
 	ASSERT (dst != NULL || size == 0);
 
+	if (size >= ERMS_THRESHOLD && cpu_has_erms ()) {
+		asm volatile ("rep stosb"
+				: "+D" (dst), "+c" (size) : "a" (value) : "memory");
+		return dst_;
+	}
+
+	if (size >= WORD_SIZE) {
+		word_t pattern = (unsigned char) value * ONES;
+
+		for (; ((uintptr_t) dst & WORD_MASK) != 0; size--)
+			*dst++ = value;
+		for (; size >= 4 * WORD_SIZE; size -= 4 * WORD_SIZE) {
+			word_t *w = (word_t *) dst;
+			w[0] = w[1] = w[2] = w[3] = pattern;
+			dst += 4 * WORD_SIZE;
+		}
+		for (; size >= WORD_SIZE; size -= WORD_SIZE, dst += WORD_SIZE)
+			*(word_t *) dst = pattern;
+	}
 	while (size-- > 0)
 		*dst++ = value;
 
@@ -270,10 +322,19 @@ memset (void *dst_, int value, size_t size) {
 size_t
 strlen (const char *string) {
 	const char *p;
+	const word_t *w;
 
 	ASSERT (string);
 
-	for (p = string; *p != '\0'; p++)
+	/* Scan bytes up to a word boundary, then whole words.  Aligned
+	   word loads never cross a page boundary, so we cannot fault
+	   past the terminator. */
+	for (p = string; ((uintptr_t) p & WORD_MASK) != 0; p++)
+		if (*p == '\0')
+			return p - string;
+	for (w = (const word_t *) p; !has_zero_byte (*w); w++)
+		continue;
+	for (p = (const char *) w; *p != '\0'; p++)
 		continue;
 	return p - string;
 }
@@ -345,3 +406,74 @@ strlcat (char *dst, const char *src, size_t size) {
 	return src_len + dst_len;
 }
 
+/* Returns true if the CPU supports Enhanced REP MOVSB/STOSB,
+   reported by CPUID.(EAX=07H,ECX=0):EBX bit 9.  The answer is
+   cached; CPUID is unprivileged, so this works in user programs
+   as well as in the kernel. */
+static bool
+cpu_has_erms (void) {
+	static int erms = -1;
+
+	if (erms < 0) {
+		uint32_t eax, ebx, ecx, edx;
+
+		asm volatile ("cpuid"
+				: "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (0));
+		if (eax >= 7) {
+			asm volatile ("cpuid"
+					: "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx)
+					: "a" (7), "c" (0));
+			erms = (ebx >> 9) & 1;
+		} else
+			erms = 0;
+	}
+	return erms;
+}
+
+/* Copies SIZE bytes from SRC to DST in ascending address order.
+   Safe for overlapping blocks as long as DST < SRC, because each
+   word is loaded before the store that might overwrite it. */
+static void
+copy_forward (unsigned char *dst, const unsigned char *src, size_t size) {
+	if (size >= WORD_SIZE) {
+		for (; ((uintptr_t) dst & WORD_MASK) != 0; size--)
+			*dst++ = *src++;
+		for (; size >= 4 * WORD_SIZE; size -= 4 * WORD_SIZE) {
+			word_t *d = (word_t *) dst;
+			const word_t *s = (const word_t *) src;
+			word_t w0 = s[0], w1 = s[1], w2 = s[2], w3 = s[3];
+			d[0] = w0;
+			d[1] = w1;
+			d[2] = w2;
+			d[3] = w3;
+			dst += 4 * WORD_SIZE;
+			src += 4 * WORD_SIZE;
+		}
+		for (; size >= WORD_SIZE; size -= WORD_SIZE) {
+			*(word_t *) dst = *(const word_t *) src;
+			dst += WORD_SIZE;
+			src += WORD_SIZE;
+		}
+	}
+	while (size-- > 0)
+		*dst++ = *src++;
+}
+
+/* Copies SIZE bytes from SRC to DST in descending address order,
+   for overlapping blocks with DST > SRC. */
+static void
+copy_backward (unsigned char *dst, const unsigned char *src, size_t size) {
+	dst += size;
+	src += size;
+	if (size >= WORD_SIZE) {
+		for (; ((uintptr_t) dst & WORD_MASK) != 0; size--)
+			*--dst = *--src;
+		for (; size >= WORD_SIZE; size -= WORD_SIZE) {
+			dst -= WORD_SIZE;
+			src -= WORD_SIZE;
+			*(word_t *) dst = *(const word_t *) src;
+		}
+	}
+	while (size-- > 0)
+		*--dst = *--src;
+}
@@ -0,0 +1,267 @@
+/* malloc.c: User heap allocator.
+
+   The heap is memory obtained from sbrk(), at least HEAP_CHUNK
+   bytes at a time, carved into blocks.  Each block starts with a
+   header word holding its size, a multiple of ALIGN, and two flags:
+   whether the block is in use and whether the block before it is.
+   A free block also keeps its size in its last word, so that the
+   block after it can find its start, and links into the free list
+   for its size class.  A freed block is merged with free blocks on
+   either side, so no two free blocks are ever adjacent.
+
+   Size classes are powers of two.  A request is served by the first
+   block that fits in its own class or, failing that, by any block
+   of the next nonempty class, which is split if what is left over
+   can make a block of its own.  The heap ends with a header of size
+   0 that is marked in use, so that nothing merges past it.
+
+   Programs that use malloc() should not move the break themselves:
+   the heap can only grow while it ends where it last left it. */
+
+#include <malloc.h>
+#include <round.h>
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+
+#define ALIGN 16                   /* Alignment of returned memory. */
+#define HDR sizeof (size_t)        /* Size of a block header. */
+#define MIN_BLOCK 32               /* Header, links and size of a free block. */
+#define HEAP_CHUNK (64 * 1024)     /* The heap grows by at least this. */
+#define CLASS_CNT 24               /* Last class: 256 MB and up. */
+
+/* Flags in a block header. */
+#define IN_USE 1
+#define PREV_IN_USE 2
+#define FLAGS (IN_USE | PREV_IN_USE)
+
+/* A block.  The links are only there while it is free; otherwise
+   the caller's memory starts right after HEAD. */
+struct block {
+	size_t head;                   /* Size | flags. */
+	struct block *next, *prev;     /* In its free list. */
+};
+
+static struct block *free_lists[CLASS_CNT];
+static struct block *heap_end;     /* The end header, or NULL. */
+
+static inline size_t
+block_size (const struct block *b) {
+	return b->head & ~(size_t) FLAGS;
+}
+
+static inline struct block *
+next_block (struct block *b) {
+	return (struct block *) ((uint8_t *) b + block_size (b));
+}
+
+/* Returns the size class of blocks of SIZE bytes: class 0 holds
+   blocks of 32 to 63 bytes, class 1 of 64 to 127 bytes, and so on. */
+static int
+size_class (size_t size) {
+	int c = 0;
+
+	for (size >>= 6; size > 0 && c < CLASS_CNT - 1; size >>= 1)
+		c++;
+	return c;
+}
+
+static void
+link_block (struct block *b) {
+	struct block **list = &free_lists[size_class (block_size (b))];
+
+	b->prev = NULL;
+	b->next = *list;
+	if (*list != NULL)
+		(*list)->prev = b;
+	*list = b;
+}
+
+static void
+unlink_block (struct block *b) {
+	if (b->prev != NULL)
+		b->prev->next = b->next;
+	else
+		free_lists[size_class (block_size (b))] = b->next;
+	if (b->next != NULL)
+		b->next->prev = b->prev;
+}
+
+/* Frees B, which is marked not in use but is on no free list:
+   merges it with the free blocks around it and links the result. */
+static void
+release (struct block *b) {
+	size_t size = block_size (b);
+	struct block *next = next_block (b);
+
+	if (!(next->head & IN_USE)) {
+		unlink_block (next);
+		size += block_size (next);
+	}
+	if (!(b->head & PREV_IN_USE)) {
+		struct block *prev = (struct block *) ((uint8_t *) b
+				- ((size_t *) b)[-1]);
+		unlink_block (prev);
+		size += block_size (prev);
+		b = prev;
+	}
+	b->head = size | PREV_IN_USE;
+	((size_t *) ((uint8_t *) b + size))[-1] = size;
+	next_block (b)->head &= ~(size_t) PREV_IN_USE;
+	link_block (b);
+}
+
+/* Sets up an empty heap at the break. */
+static bool
+heap_init (void) {
+	uint8_t *base = sbrk (0);
+	size_t pad;
+
+	if (base == (void *) -1)
+		return false;
+	/* Headers sit just below ALIGN boundaries. */
+	pad = ROUND_UP ((uintptr_t) base + HDR, ALIGN) - HDR - (uintptr_t) base;
+	if (sbrk (pad + HDR) != base)
+		return false;
+	heap_end = (struct block *) (base + pad);
+	heap_end->head = IN_USE | PREV_IN_USE;
+	return true;
+}
+
+/* Adds a free block of at least SIZE bytes to the end of the heap.
+   Returns false if the break cannot be moved. */
+static bool
+heap_grow (size_t size) {
+	size_t n = size > HEAP_CHUNK ? ROUND_UP (size, HEAP_CHUNK) : HEAP_CHUNK;
+	struct block *b = heap_end;
+	uint8_t *old = sbrk (n);
+
+	if (old == (void *) -1)
+		return false;
+	if (old != (uint8_t *) heap_end + HDR) {
+		/* Someone else moved the break. */
+		sbrk (-(intptr_t) n);
+		return false;
+	}
+
+	/* The old end header becomes the new block's header. */
+	b->head = n | (b->head & PREV_IN_USE);
+	heap_end = (struct block *) ((uint8_t *) b + n);
+	heap_end->head = IN_USE;
+	release (b);
+	return true;
+}
+
+/* Returns a free block of at least SIZE bytes, or NULL. */
+static struct block *
+find_fit (size_t size) {
+	int c = size_class (size);
+
+	for (struct block *b = free_lists[c]; b != NULL; b = b->next)
+		if (block_size (b) >= size)
+			return b;
+	for (c++; c < CLASS_CNT; c++)
+		if (free_lists[c] != NULL)
+			return free_lists[c];
+	return NULL;
+}
+
+/* Takes SIZE bytes from the front of free block B for the caller,
+   leaving the rest free if it is big enough to be a block. */
+static void *
+place (struct block *b, size_t size) {
+	size_t total = block_size (b);
+
+	unlink_block (b);
+	if (total - size >= MIN_BLOCK) {
+		struct block *rest = (struct block *) ((uint8_t *) b + size);
+
+		b->head = size | IN_USE | (b->head & PREV_IN_USE);
+		rest->head = (total - size) | PREV_IN_USE;
+		((size_t *) next_block (rest))[-1] = total - size;
+		link_block (rest);
+	} else {
+		b->head |= IN_USE;
+		next_block (b)->head |= PREV_IN_USE;
+	}
+	return (uint8_t *) b + HDR;
+}
+
+/* Obtains and returns a new block of at least SIZE bytes, aligned
+   to ALIGN bytes.  Returns a null pointer if SIZE is 0 or memory
+   is not available. */
+void *
+malloc (size_t n) {
+	struct block *b;
+	size_t size;
+
+	if (n == 0 || n > SIZE_MAX / 2)
+		return NULL;
+	size = ROUND_UP (n + HDR, ALIGN);
+	if (size < MIN_BLOCK)
+		size = MIN_BLOCK;
+	if (heap_end == NULL && !heap_init ())
+		return NULL;
+
+	b = find_fit (size);
+	if (b == NULL) {
+		if (!heap_grow (size))
+			return NULL;
+		b = find_fit (size);
+	}
+	return place (b, size);
+}
+
+/* Allocates and returns A times B bytes initialized to zeroes.
+   Returns a null pointer if memory is not available. */
+void *
+calloc (size_t a, size_t b) {
+	void *p;
+
+	if (b != 0 && a > SIZE_MAX / b)
+		return NULL;
+	p = malloc (a * b);
+	if (p != NULL)
+		memset (p, 0, a * b);
+	return p;
+}
+
+/* Attempts to resize OLD to NEW_SIZE bytes, which may move it.  If
+   successful, returns the new block; on failure, returns a null
+   pointer and leaves OLD alone.  A call with null OLD is equivalent
+   to malloc(); a call with zero NEW_SIZE is equivalent to free(). */
+void *
+realloc (void *old, size_t new_size) {
+	size_t have;
+	void *new;
+
+	if (old == NULL)
+		return malloc (new_size);
+	if (new_size == 0) {
+		free (old);
+		return NULL;
+	}
+
+	have = block_size ((struct block *) ((uint8_t *) old - HDR)) - HDR;
+	if (new_size <= have)
+		return old;
+	new = malloc (new_size);
+	if (new != NULL) {
+		memcpy (new, old, have);
+		free (old);
+	}
+	return new;
+}
+
+/* Frees block P, which must have been previously allocated with
+   malloc(), calloc(), or realloc(). */
+void
+free (void *p) {
+	struct block *b;
+
+	if (p == NULL)
+		return;
+	b = (struct block *) ((uint8_t *) p - HDR);
+	b->head &= ~(size_t) IN_USE;
+	release (b);
+}
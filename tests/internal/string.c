@@ -0,0 +1,196 @@
+/* Test and benchmark program for the block functions in
+   lib/string.c.
+
+   Checks memcpy(), memmove(), memset(), memcmp() and strlen()
+   against simple byte-at-a-time reference loops for every
+   combination of small sizes and misalignments, and for large
+   blocks that take the `rep movsb'/`rep stosb' paths, then reports
+   throughput in GB/s for each size class.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <inttypes.h>
+#include <random.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/test.h"
+
+/* Largest block we verify or benchmark, plus room for skew. */
+#define MAX_SIZE 65536
+#define SLACK 64
+
+/* Size classes reported by the benchmark. */
+static const size_t bench_sizes[] = {8, 64, 512, 4096, 65536};
+
+/* Bytes moved per size class before the clock is read. */
+#define BENCH_BYTES (64 * 1024 * 1024)
+
+static uint8_t buf_a[MAX_SIZE + SLACK];
+static uint8_t buf_b[MAX_SIZE + SLACK];
+static uint8_t buf_ref[MAX_SIZE + SLACK];
+
+/* Keeps the results of memcmp() and strlen() in the benchmark. */
+static volatile size_t sink;
+
+static void verify (void);
+static void verify_size (size_t size, size_t src_ofs, size_t dst_ofs);
+static void bench (void (*op) (size_t), size_t size);
+
+static void op_memcpy (size_t size) { memcpy (buf_b, buf_a + 1, size); }
+static void op_memmove (size_t size) { memmove (buf_a + 3, buf_a, size); }
+static void op_memset (size_t size) { memset (buf_b, 0x5a, size); }
+static void op_memcmp (size_t size) { sink = memcmp (buf_a, buf_ref, size); }
+static void
+op_strlen (size_t size)
+{
+  buf_b[size - 1] = '\0';
+  sink = strlen ((const char *) buf_b);
+}
+
+/* Test the block functions, then time them. */
+void
+test (void)
+{
+  size_t i;
+
+  verify ();
+
+  printf ("%-8s", "size");
+  for (i = 0; i < sizeof bench_sizes / sizeof *bench_sizes; i++)
+    printf (" %9zu", bench_sizes[i]);
+  printf ("\n");
+
+#define BENCH_ROW(NAME, OP)                                             \
+  do                                                                    \
+    {                                                                   \
+      printf ("%-8s", NAME);                                            \
+      for (i = 0; i < sizeof bench_sizes / sizeof *bench_sizes; i++)    \
+        bench (OP, bench_sizes[i]);                                     \
+      printf ("\n");                                                    \
+    }                                                                   \
+  while (0)
+
+  memset (buf_b, 'x', sizeof buf_b);
+  memcpy (buf_ref, buf_a, sizeof buf_ref);
+  BENCH_ROW ("memcpy", op_memcpy);
+  BENCH_ROW ("memmove", op_memmove);
+  BENCH_ROW ("memset", op_memset);
+  memcpy (buf_ref, buf_a, sizeof buf_ref);
+  BENCH_ROW ("memcmp", op_memcmp);
+  memset (buf_b, 'x', sizeof buf_b);
+  BENCH_ROW ("strlen", op_strlen);
+
+  printf ("string: PASS\n");
+}
+
+/* Sizes past the small ones in verify(): either side of the point
+   where lib/string.c switches to `rep movsb' and `rep stosb', and
+   blocks large enough to spend most of their time in the word
+   loops, with odd tails. */
+static const size_t large_sizes[] = {511, 512, 513, 1000, 4096 + 3, 16384 + 5};
+
+/* Compares each function against a reference loop for sizes up
+   to 3 words past a large block, then for LARGE_SIZES, each with
+   every source/destination skew within a word. */
+static void
+verify (void)
+{
+  size_t size, src_ofs, dst_ofs, i;
+
+  printf ("verifying block functions...");
+  for (size = 0; size <= 128 + 24; size = size < 128 ? size + 1 : size + 8)
+    for (src_ofs = 0; src_ofs < 8; src_ofs++)
+      for (dst_ofs = 0; dst_ofs < 8; dst_ofs++)
+        verify_size (size, src_ofs, dst_ofs);
+  for (i = 0; i < sizeof large_sizes / sizeof *large_sizes; i++)
+    for (src_ofs = 0; src_ofs < 8; src_ofs++)
+      for (dst_ofs = 0; dst_ofs < 8; dst_ofs++)
+        verify_size (large_sizes[i], src_ofs, dst_ofs);
+  printf (" done\n");
+}
+
+/* Checks each function on SIZE bytes at SRC_OFS and DST_OFS. */
+static void
+verify_size (size_t size, size_t src_ofs, size_t dst_ofs)
+{
+  /* Checking memcmp() with the difference at every position is
+     quadratic, so large blocks try every 61st position, which
+     still hits each offset within a word. */
+  size_t step = size <= 256 ? 1 : 61;
+  size_t i;
+
+  random_bytes (buf_a, sizeof buf_a);
+  random_bytes (buf_b, sizeof buf_b);
+
+  /* memcpy. */
+  memcpy (buf_ref, buf_b, sizeof buf_ref);
+  for (i = 0; i < size; i++)
+    buf_ref[dst_ofs + i] = buf_a[src_ofs + i];
+  ASSERT (memcpy (buf_b + dst_ofs, buf_a + src_ofs, size)
+          == buf_b + dst_ofs);
+  ASSERT (!memcmp (buf_b, buf_ref, sizeof buf_ref));
+
+  /* memmove, overlapping in both directions. */
+  memcpy (buf_ref, buf_a, sizeof buf_ref);
+  for (i = size; i-- > 0; )
+    buf_ref[dst_ofs + 16 + i] = buf_ref[src_ofs + i];
+  ASSERT (memmove (buf_a + dst_ofs + 16, buf_a + src_ofs, size)
+          == buf_a + dst_ofs + 16);
+  ASSERT (!memcmp (buf_a, buf_ref, sizeof buf_ref));
+  for (i = 0; i < size; i++)
+    buf_ref[dst_ofs + i] = buf_ref[src_ofs + 16 + i];
+  ASSERT (memmove (buf_a + dst_ofs, buf_a + src_ofs + 16, size)
+          == buf_a + dst_ofs);
+  ASSERT (!memcmp (buf_a, buf_ref, sizeof buf_ref));
+
+  /* memset. */
+  memcpy (buf_ref, buf_b, sizeof buf_ref);
+  for (i = 0; i < size; i++)
+    buf_ref[dst_ofs + i] = (uint8_t) (src_ofs + 0xf0);
+  memset (buf_b + dst_ofs, src_ofs + 0xf0, size);
+  ASSERT (!memcmp (buf_b, buf_ref, sizeof buf_ref));
+
+  /* memcmp, with the difference in every position. */
+  memcpy (buf_ref + dst_ofs, buf_a + src_ofs, size);
+  ASSERT (memcmp (buf_ref + dst_ofs, buf_a + src_ofs, size) == 0);
+  for (i = 0; i < size; i += step)
+    {
+      buf_ref[dst_ofs + i]++;
+      ASSERT ((memcmp (buf_ref + dst_ofs, buf_a + src_ofs, size) > 0)
+              == (buf_ref[dst_ofs + i] > buf_a[src_ofs + i]));
+      buf_ref[dst_ofs + i]--;
+    }
+
+  /* strlen. */
+  memset (buf_b, 'x', size + dst_ofs + 1);
+  buf_b[dst_ofs + size] = '\0';
+  ASSERT (strlen ((const char *) buf_b + dst_ofs) == size);
+}
+
+/* Runs OP on SIZE bytes until BENCH_BYTES have been processed
+   and prints the resulting throughput in GB/s. */
+static void
+bench (void (*op) (size_t), size_t size)
+{
+  size_t iterations = BENCH_BYTES / size;
+  int64_t start, ticks;
+  uint64_t mb_per_s;
+  size_t i;
+
+  start = timer_ticks ();
+  for (i = 0; i < iterations; i++)
+    op (size);
+  ticks = timer_elapsed (start);
+  if (ticks == 0)
+    ticks = 1;
+
+  mb_per_s = (uint64_t) iterations * size / ticks * TIMER_FREQ
+             / (1000 * 1000);
+  printf (" %5"PRIu64".%03"PRIu64, mb_per_s / 1000, mb_per_s % 1000);
+}
@@ -0,0 +1,97 @@
+/* Grows and shrinks the heap with sbrk() and brk(), then runs
+   malloc() and friends over many blocks, checking that blocks are
+   aligned and keep their contents, and that freed blocks are
+   merged back into one. */
+
+#include <malloc.h>
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (16 * 4096)
+#define BLOCK_CNT 256
+
+static char *blocks[BLOCK_CNT];
+
+static size_t
+block_size (int i)
+{
+  return (size_t) i * 37 % 2000 + 1;
+}
+
+static void
+check_block (int i, size_t size)
+{
+  size_t j;
+
+  for (j = 0; j < size; j++)
+    if (blocks[i][j] != (char) i)
+      fail ("block %d: byte %zu was not kept", i, j);
+}
+
+void
+test_main (void)
+{
+  char *start, *end, *p;
+  size_t i;
+  int b;
+
+  CHECK ((start = sbrk (0)) != (void *) -1, "sbrk (0)");
+  CHECK (sbrk (SIZE) == start, "sbrk (%d)", SIZE);
+  for (i = 0; i < SIZE; i++)
+    if (start[i] != 0)
+      fail ("byte %zu of new heap is not zero", i);
+  memset (start, 0x5a, SIZE);
+  CHECK (sbrk (0) == start + SIZE, "break moved up");
+  CHECK (brk (start + SIZE / 2) == 0, "brk shrinks the heap");
+  CHECK (sbrk (SIZE / 2) == start + SIZE / 2, "sbrk grows it again");
+  for (i = SIZE / 2; i < SIZE; i++)
+    if (start[i] != 0)
+      fail ("byte %zu of regrown heap is not zero", i);
+  CHECK (brk (start - 4096) == -1, "brk below the heap fails");
+  CHECK (brk (start) == 0, "brk back to the start");
+
+  for (b = 0; b < BLOCK_CNT; b++)
+    {
+      blocks[b] = malloc (block_size (b));
+      if (blocks[b] == NULL)
+        fail ("malloc of block %d failed", b);
+      if ((uintptr_t) blocks[b] % 16 != 0)
+        fail ("block %d is misaligned", b);
+      memset (blocks[b], b, block_size (b));
+    }
+  msg ("malloc %d blocks", BLOCK_CNT);
+
+  for (b = 0; b < BLOCK_CNT; b += 2)
+    free (blocks[b]);
+  for (b = 0; b < BLOCK_CNT; b += 2)
+    {
+      blocks[b] = calloc (block_size (b), 1);
+      if (blocks[b] == NULL)
+        fail ("calloc of block %d failed", b);
+      for (i = 0; i < block_size (b); i++)
+        if (blocks[b][i] != 0)
+          fail ("calloc block %d is not zeroed", b);
+      memset (blocks[b], b, block_size (b));
+    }
+  for (b = 1; b < BLOCK_CNT; b += 2)
+    {
+      blocks[b] = realloc (blocks[b], block_size (b) + 3000);
+      if (blocks[b] == NULL)
+        fail ("realloc of block %d failed", b);
+    }
+  for (b = 0; b < BLOCK_CNT; b++)
+    check_block (b, block_size (b));
+  msg ("free, calloc and realloc keep contents");
+
+  for (b = 0; b < BLOCK_CNT; b++)
+    free (blocks[b]);
+  end = sbrk (0);
+  p = malloc (end - start - 4096);
+  if (p == NULL || sbrk (0) != end)
+    fail ("freed blocks were not merged");
+  free (p);
+  msg ("freed blocks merge");
+}
@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(heap) begin
+(heap) sbrk (0)
+(heap) sbrk (65536)
+(heap) break moved up
+(heap) brk shrinks the heap
+(heap) sbrk grows it again
+(heap) brk below the heap fails
+(heap) brk back to the start
+(heap) malloc 256 blocks
+(heap) free, calloc and realloc keep contents
+(heap) freed blocks merge
+(heap) end
+EOF
+pass;
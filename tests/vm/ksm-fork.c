@@ -0,0 +1,84 @@
+/* Forks children that each hold a copy of the same 256 kB buffer,
+   whose pages come in groups of identical contents, so that KSM
+   can merge them within and across processes.  Each child reads
+   sample.txt repeatedly, blocking on the disk to give ksmd time to
+   run, then writes a value of its own to every page and checks
+   that no other page or process saw the write.  Run with -ksm. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE 4096
+#define PAGE_CNT 64
+#define CHILD_CNT 3
+
+static char buf[PAGE_CNT * PAGE];
+
+/* Pages 0, 4, 8... are alike, as are 1, 5, 9..., and so on. */
+static char
+pattern (size_t page)
+{
+  return (char) ('a' + page % 4);
+}
+
+static void
+verify (const char *who, int salt)
+{
+  size_t i;
+
+  for (i = 0; i < sizeof buf; i++)
+    if (buf[i] != (char) (pattern (i / PAGE) + salt))
+      fail ("%s: byte %zu is %d, expected %d",
+            who, i, buf[i], pattern (i / PAGE) + salt);
+}
+
+static void
+idle_on_disk (void)
+{
+  char block[512];
+  int fd, i;
+
+  for (i = 0; i < 20; i++)
+    {
+      fd = open ("sample.txt");
+      if (fd < 2)
+        fail ("open \"sample.txt\" failed");
+      while (read (fd, block, sizeof block) > 0)
+        continue;
+      close (fd);
+    }
+}
+
+void
+test_main (void)
+{
+  pid_t children[CHILD_CNT];
+  size_t i;
+  int c;
+
+  for (i = 0; i < sizeof buf; i++)
+    buf[i] = pattern (i / PAGE);
+
+  for (c = 0; c < CHILD_CNT; c++)
+    {
+      children[c] = fork ("ksm-child");
+      if (children[c] == 0)
+        {
+          idle_on_disk ();
+          verify ("child before write", 0);
+          for (i = 0; i < sizeof buf; i++)
+            buf[i] = (char) (pattern (i / PAGE) + c + 1);
+          idle_on_disk ();
+          verify ("child after write", c + 1);
+          exit (c + 1);
+        }
+    }
+  for (c = 0; c < CHILD_CNT; c++)
+    CHECK (wait (children[c]) == c + 1, "wait for child %d", c);
+
+  msg ("verify parent");
+  idle_on_disk ();
+  verify ("parent", 0);
+}
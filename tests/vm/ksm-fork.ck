@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(ksm-fork) begin
+(ksm-fork) wait for child 0
+(ksm-fork) wait for child 1
+(ksm-fork) wait for child 2
+(ksm-fork) verify parent
+(ksm-fork) end
+EOF
+pass;
@@ -0,0 +1,51 @@
+/* Exercises madvise(): dropped anonymous pages read back as
+   zeros, advised file pages keep their contents, pages marked
+   cold are still readable, and bad arguments are refused. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE 4096
+
+static char buf[16 * PAGE] __attribute__ ((aligned (PAGE)));
+
+void
+test_main (void)
+{
+  char *actual = (char *) 0x10000000;
+  int handle;
+  void *map;
+  size_t i;
+
+  memset (buf, 0x5a, sizeof buf);
+  CHECK (madvise (buf + PAGE, 8 * PAGE, MADV_DONTNEED) == 0,
+         "madvise DONTNEED");
+  for (i = 0; i < sizeof buf; i++)
+    {
+      char expect = i >= PAGE && i < 9 * PAGE ? 0 : 0x5a;
+      if (buf[i] != expect)
+        fail ("byte %zu is %02hhx (should be %02hhx)", i, buf[i], expect);
+    }
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((map = mmap (actual, PAGE, 0, handle, 0)) != MAP_FAILED,
+         "mmap \"sample.txt\"");
+  CHECK (madvise (map, PAGE, MADV_SEQUENTIAL) == 0, "madvise SEQUENTIAL");
+  CHECK (madvise (map, PAGE, MADV_WILLNEED) == 0, "madvise WILLNEED");
+  if (memcmp (actual, sample, strlen (sample)))
+    fail ("read of mmap'd file reported bad data");
+
+  CHECK (madvise (buf, sizeof buf, MADV_COLD) == 0, "madvise COLD");
+  if (buf[0] != 0x5a || buf[sizeof buf - 1] != 0x5a)
+    fail ("cold pages lost their contents");
+
+  CHECK (madvise (buf + 1, PAGE, MADV_NORMAL) == -1,
+         "madvise unaligned address (must fail)");
+  CHECK (madvise (buf, PAGE, 99) == -1, "madvise bad advice (must fail)");
+
+  munmap (map);
+  close (handle);
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(madvise) begin
+(madvise) madvise DONTNEED
+(madvise) open "sample.txt"
+(madvise) mmap "sample.txt"
+(madvise) madvise SEQUENTIAL
+(madvise) madvise WILLNEED
+(madvise) madvise COLD
+(madvise) madvise unaligned address (must fail)
+(madvise) madvise bad advice (must fail)
+(madvise) end
+EOF
+pass;
@@ -0,0 +1,56 @@
+/* Maps anonymous memory, lazily and with MAP_POPULATE, checks that
+   it reads as zeros and keeps what is written to it, and that it
+   can be unmapped.  Then maps a file with MAP_POPULATE and checks
+   its contents. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (64 * 4096)
+
+static void
+check_anon (char *p, const char *name)
+{
+  size_t i;
+
+  for (i = 0; i < SIZE; i++)
+    if (p[i] != 0)
+      fail ("%s: byte %zu is not zero", name, i);
+  for (i = 0; i < SIZE; i++)
+    p[i] = i % 253;
+  for (i = 0; i < SIZE; i++)
+    if (p[i] != (char) (i % 253))
+      fail ("%s: byte %zu was not kept", name, i);
+  msg ("%s: zero-filled and writable", name);
+}
+
+void
+test_main (void)
+{
+  char *lazy = (char *) 0x10000000;
+  char *eager = (char *) 0x20000000;
+  char *file = (char *) 0x30000000;
+  int handle;
+
+  CHECK (mmap (lazy, SIZE, 1 | MAP_ANONYMOUS, -1, 0) == lazy,
+         "mmap anonymous");
+  check_anon (lazy, "lazy");
+  CHECK (mmap (eager, SIZE, 1 | MAP_ANONYMOUS | MAP_POPULATE, -1, 0)
+         == eager, "mmap anonymous, populated");
+  check_anon (eager, "populated");
+  munmap (lazy);
+  CHECK (mmap (lazy, SIZE, 1 | MAP_ANONYMOUS, -1, 0) == lazy,
+         "mmap anonymous again after munmap");
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (mmap (file, 4096, MAP_POPULATE, handle, 0) == file,
+         "mmap \"sample.txt\", populated");
+  if (memcmp (file, sample, strlen (sample)))
+    fail ("populated mapping has bad data");
+  msg ("populated mapping has file data");
+  munmap (file);
+  close (handle);
+}
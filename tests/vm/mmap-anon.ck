@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-anon) begin
+(mmap-anon) mmap anonymous
+(mmap-anon) lazy: zero-filled and writable
+(mmap-anon) mmap anonymous, populated
+(mmap-anon) populated: zero-filled and writable
+(mmap-anon) mmap anonymous again after munmap
+(mmap-anon) open "sample.txt"
+(mmap-anon) mmap "sample.txt", populated
+(mmap-anon) populated mapping has file data
+(mmap-anon) end
+EOF
+pass;
@@ -0,0 +1,56 @@
+/* Maps a file, forks, and checks that the mapping is shared: a
+   store by the child is seen by the parent through its mapping
+   and through read(), and a write() by the parent is seen through
+   the mapping. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static const char child_msg[] = "child was here";
+static const char parent_msg[] = "parent wrote this";
+
+void
+test_main (void)
+{
+  char *actual = (char *) 0x10000000;
+  char buf[sizeof child_msg];
+  int handle;
+  pid_t child;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (mmap (actual, 4096, 1, handle, 0) != MAP_FAILED,
+         "mmap \"sample.txt\"");
+  if (memcmp (actual, sample, strlen (sample)))
+    fail ("read of mmap'd file reported bad data");
+
+  child = fork ("child");
+  if (child == 0)
+    {
+      memcpy (actual, child_msg, sizeof child_msg);
+      exit (0);
+    }
+  CHECK (wait (child) == 0, "wait for child");
+
+  if (memcmp (actual, child_msg, sizeof child_msg))
+    fail ("child's store not seen through parent's mapping");
+  msg ("child's store seen through mapping");
+
+  seek (handle, 0);
+  CHECK (read (handle, buf, sizeof buf) == (int) sizeof buf,
+         "read \"sample.txt\"");
+  if (memcmp (buf, child_msg, sizeof child_msg))
+    fail ("child's store not seen by read()");
+
+  seek (handle, 100);
+  CHECK (write (handle, parent_msg, sizeof parent_msg)
+         == (int) sizeof parent_msg, "write \"sample.txt\"");
+  if (memcmp (actual + 100, parent_msg, sizeof parent_msg))
+    fail ("write() not seen through mapping");
+  msg ("write() seen through mapping");
+
+  munmap (actual);
+  close (handle);
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-shared) begin
+(mmap-shared) open "sample.txt"
+(mmap-shared) mmap "sample.txt"
+(mmap-shared) wait for child
+(mmap-shared) child's store seen through mapping
+(mmap-shared) read "sample.txt"
+(mmap-shared) write "sample.txt"
+(mmap-shared) write() seen through mapping
+(mmap-shared) end
+EOF
+pass;
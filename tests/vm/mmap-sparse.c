@@ -0,0 +1,45 @@
+/* Maps a small file with a mapping far larger than the file,
+   touches a few scattered pages of it, and checks that the
+   mapping behaves as one region: overlapping it fails, and once
+   unmapped the same range can be mapped again. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define MAP_SIZE (64 * 1024 * 1024)
+
+void
+test_main (void)
+{
+  char *actual = (char *) 0x10000000;
+  int handle;
+  void *map;
+  size_t i;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((map = mmap (actual, MAP_SIZE, 1, handle, 0)) != MAP_FAILED,
+         "mmap \"sample.txt\" over 64 MB");
+
+  if (memcmp (actual, sample, strlen (sample)))
+    fail ("read of mmap'd file reported bad data");
+  for (i = 1; i < 16; i++)
+    {
+      char *p = actual + i * (MAP_SIZE / 16) - 1;
+      if (*p != 0)
+        fail ("byte %p past end of file is %02hhx (should be 0)", p, *p);
+      *p = 'x';
+    }
+
+  CHECK (mmap (actual + MAP_SIZE / 2, 4096, 0, handle, 0) == MAP_FAILED,
+         "try to mmap inside the mapping");
+  munmap (map);
+  CHECK ((map = mmap (actual + MAP_SIZE / 2, 4096, 0, handle, 0))
+         != MAP_FAILED, "mmap inside the unmapped range");
+  if (memcmp (map, sample, strlen (sample)))
+    fail ("read of second mapping reported bad data");
+  munmap (map);
+  close (handle);
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-sparse) begin
+(mmap-sparse) open "sample.txt"
+(mmap-sparse) mmap "sample.txt" over 64 MB
+(mmap-sparse) try to mmap inside the mapping
+(mmap-sparse) mmap inside the unmapped range
+(mmap-sparse) end
+EOF
+pass;
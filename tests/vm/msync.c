@@ -0,0 +1,58 @@
+/* Stores into a writable file mapping and writes it back with
+   msync(), and checks that the file holds the stores.  Also
+   checks that msync() rejects bad arguments.
+
+   read() goes through the same page cache as the mapping, and
+   munmap() writes back too, so the file's contents cannot tell
+   whether msync() wrote anything.  The kernel counts the pages
+   msync() writes back, and msync.ck checks that count in the
+   statistics printed at shutdown. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static const char msg_text[] = "synced through the mapping";
+
+void
+test_main (void)
+{
+  char *actual = (char *) 0x10000000;
+  char buf[sizeof msg_text];
+  int handle;
+  int i;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (mmap (actual, 4096, 1, handle, 0) != MAP_FAILED,
+         "mmap \"sample.txt\"");
+
+  /* flushd may write the page back between a store and msync(),
+     leaving msync() nothing to do, but not every time. */
+  for (i = 0; i < 3; i++)
+    {
+      memcpy (actual + 10, msg_text, sizeof msg_text);
+      if (msync (actual, 4096, MS_SYNC) != 0)
+        fail ("msync MS_SYNC failed");
+    }
+  msg ("msync MS_SYNC");
+
+  CHECK (msync (actual + 1, 4096, MS_SYNC) == -1, "msync unaligned");
+  CHECK (msync (actual, 4096, MS_SYNC | MS_ASYNC) == -1,
+         "msync with MS_SYNC and MS_ASYNC");
+  CHECK (msync (actual + 8192, 4096, MS_SYNC) == -1, "msync unmapped");
+  CHECK (msync (actual, 4096, MS_ASYNC) == 0, "msync MS_ASYNC");
+
+  munmap (actual);
+  close (handle);
+
+  CHECK ((handle = open ("sample.txt")) > 1, "reopen \"sample.txt\"");
+  seek (handle, 10);
+  CHECK (read (handle, buf, sizeof buf) == (int) sizeof buf,
+         "read \"sample.txt\"");
+  if (memcmp (buf, msg_text, sizeof msg_text))
+    fail ("msync'd store not in file");
+  msg ("msync'd store in file");
+  close (handle);
+}
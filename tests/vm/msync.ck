@@ -0,0 +1,27 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(msync) begin
+(msync) open "sample.txt"
+(msync) mmap "sample.txt"
+(msync) msync MS_SYNC
+(msync) msync unaligned
+(msync) msync with MS_SYNC and MS_ASYNC
+(msync) msync unmapped
+(msync) msync MS_ASYNC
+(msync) reopen "sample.txt"
+(msync) read "sample.txt"
+(msync) msync'd store in file
+(msync) end
+EOF
+
+# The file would hold the stores just the same if msync() did
+# nothing and munmap() wrote the page back, so also check that
+# msync() wrote pages back itself.
+our ($test);
+my ($stats) = grep (/^Write-back: /, read_text_file ("$test.output"));
+fail "msync wrote nothing back\n"
+  if !defined $stats || $stats !~ /([1-9]\d*) by msync$/;
+pass;
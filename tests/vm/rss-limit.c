@@ -0,0 +1,33 @@
+/* Limits the process to a small resident set, then writes and
+   checks 1 MB of memory, which it can only do by evicting its own
+   pages, and checks that the limit can be read back and removed. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (1024 * 1024)
+#define LIMIT 32
+
+static char buf[SIZE];
+
+void
+test_main (void)
+{
+  size_t i;
+
+  CHECK (set_rss_limit (8) == -1, "limit below minimum refused");
+  CHECK (set_rss_limit (LIMIT) == 0, "set limit to %d pages", LIMIT);
+
+  msg ("write pass");
+  for (i = 0; i < SIZE; i++)
+    buf[i] = i % 251;
+
+  msg ("read pass");
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != (char) (i % 251))
+      fail ("byte %zu is %d, not %zu", i, buf[i], i % 251);
+
+  CHECK (set_rss_limit (0) == LIMIT, "remove limit");
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(rss-limit) begin
+(rss-limit) limit below minimum refused
+(rss-limit) set limit to 32 pages
+(rss-limit) write pass
+(rss-limit) read pass
+(rss-limit) remove limit
+(rss-limit) end
+EOF
+pass;
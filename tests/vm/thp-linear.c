@@ -0,0 +1,58 @@
+/* Fills a 4 MB buffer in the BSS, which spans at least one whole
+   2 MB aligned region, and verifies it.  Run with -thp, so that
+   region is mapped with a huge page.  Then forks, so the child
+   copies from the huge page, and verifies the buffer again in
+   both processes. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (4 * 1024 * 1024)
+
+static char buf[SIZE];
+
+/* Returns the byte expected at buf[IDX]: the page number, so that
+   a page mapped to the wrong frame shows up. */
+static char
+expected (size_t idx)
+{
+  return (char) (idx / 4096 * 7 + 1);
+}
+
+static void
+verify (const char *who)
+{
+  size_t i;
+
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != expected (i))
+      fail ("%s: byte %zu is %d, expected %d",
+            who, i, buf[i], expected (i));
+}
+
+void
+test_main (void)
+{
+  pid_t child;
+  size_t i;
+
+  msg ("initialize");
+  for (i = 0; i < SIZE; i++)
+    buf[i] = expected (i);
+
+  msg ("read pass");
+  verify ("parent");
+
+  child = fork ("thp-child");
+  if (child == 0)
+    {
+      verify ("child");
+      exit (81);
+    }
+  CHECK (wait (child) == 81, "wait for child");
+
+  msg ("read pass after fork");
+  verify ("parent");
+}
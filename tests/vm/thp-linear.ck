@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(thp-linear) begin
+(thp-linear) initialize
+(thp-linear) read pass
+(thp-linear) wait for child
+(thp-linear) read pass after fork
+(thp-linear) end
+EOF
+pass;
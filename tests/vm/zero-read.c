@@ -0,0 +1,63 @@
+/* Reads every page of a 2 MB buffer in the BSS before writing any
+   of it, so that the read faults can be served by the shared zero
+   page.  Then writes to some of the pages, both directly and by
+   read() from a file into them, and checks that each write landed
+   only in its own page. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (2 * 1024 * 1024)
+#define PAGE 4096
+
+static char buf[SIZE];
+static const char text[] = "zero page test data";
+
+/* Checks that every byte of BUF is zero except in the pages whose
+   number is a multiple of STRIDE. */
+static void
+verify (size_t stride)
+{
+  size_t i;
+
+  for (i = 0; i < SIZE; i++)
+    if (stride != 0 && i / PAGE % stride == 0)
+      i += PAGE - 1;
+    else if (buf[i] != 0)
+      fail ("byte %zu is %d, expected 0", i, buf[i]);
+}
+
+void
+test_main (void)
+{
+  size_t i;
+  int fd;
+
+  msg ("read pass");
+  verify (0);
+
+  msg ("write every 16th page");
+  for (i = 0; i < SIZE; i += 16 * PAGE)
+    memset (buf + i, 'x', PAGE);
+  verify (16);
+  for (i = 0; i < SIZE; i += 16 * PAGE)
+    if (buf[i] != 'x' || buf[i + PAGE - 1] != 'x')
+      fail ("page %zu lost its contents", i / PAGE);
+
+  CHECK (create ("zero.txt", sizeof text), "create \"zero.txt\"");
+  CHECK ((fd = open ("zero.txt")) > 1, "open \"zero.txt\"");
+  CHECK (write (fd, text, sizeof text) == (int) sizeof text,
+         "write \"zero.txt\"");
+  seek (fd, 0);
+  CHECK (read (fd, buf + 5 * PAGE, sizeof text) == (int) sizeof text,
+         "read \"zero.txt\" into a zero page");
+  if (memcmp (buf + 5 * PAGE, text, sizeof text))
+    fail ("read() data not in buffer");
+  memset (buf + 5 * PAGE, 0, sizeof text);
+  close (fd);
+
+  msg ("read pass after writes");
+  verify (16);
+}
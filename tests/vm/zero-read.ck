@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(zero-read) begin
+(zero-read) read pass
+(zero-read) write every 16th page
+(zero-read) create "zero.txt"
+(zero-read) open "zero.txt"
+(zero-read) write "zero.txt"
+(zero-read) read "zero.txt" into a zero page
+(zero-read) read pass after writes
+(zero-read) end
+EOF
+pass;
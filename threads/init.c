@@ -21,6 +21,7 @@
 #include "threads/palloc.h"
 #include "threads/pte.h"
 #include "threads/thread.h"
+#include "intrinsic.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #include "userprog/exception.h"
@@ -49,6 +50,13 @@ static bool format_filesys;
 /* -q: Power off after kernel tasks complete? */
 bool power_off_when_done;
 
+/* -nolargepage: Map physical memory with 4 kB pages only? */
+static bool no_large_pages;
+
+/* Kernel map built by paging_init(), for print_stats(). */
+static size_t kmap_large_cnt, kmap_small_cnt;
+static uint64_t kmap_cycles;
+
 bool thread_tests;
 
 static void bss_init (void);
@@ -56,6 +64,9 @@ static void paging_init (uint64_t mem_end);
 
 static char **read_command_line (void);
 static char **parse_options (char **argv);
+#ifdef VM
+static void parse_swap (const char *spec);
+#endif
 static void run_actions (char **argv);
 static void usage (void);
 
@@ -86,6 +97,7 @@ main (void) {
 	mem_end = palloc_init ();
 	malloc_init ();
 	paging_init (mem_end);
+	pml4_pcid_init ();
 
 #ifdef USERPROG
 	tss_init ();
@@ -142,29 +154,55 @@ bss_init (void) {
 
 /* Populates the page table with the kernel virtual mapping,
  * and then sets up the CPU to use the new page directory.
- * Points base_pml4 to the pml4 it creates. */
+ * Points base_pml4 to the pml4 it creates.
+ *
+ * Every aligned 2 MB of physical memory is mapped with one large
+ * page, which saves a page table per 2 MB and lets one TLB entry
+ * cover it.  The 2 MB regions that hold kernel text must stay
+ * read-only, so they, the first 2 MB (whose legacy VGA and ROM
+ * holes have their own memory types) and any unaligned tail are
+ * mapped with 4 kB pages.  -nolargepage maps everything with 4 kB pages, for
+ * comparison. */
 static void
 paging_init (uint64_t mem_end) {
 	uint64_t *pml4, *pte;
+	uint64_t start_tsc = rdtsc ();
 	int perm;
-	pml4 = base_pml4 = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+	pml4 = base_pml4 = palloc_get_page (PAL_ASSERT | PAL_ZERO | PAL_TAG (MEM_PGTBL));
 
 	extern char start, _end_kernel_text;
+	uint64_t text_start = (uint64_t) &start & ~LARGE_PGMASK;
+	uint64_t text_end = (uint64_t) &_end_kernel_text;
+
 	// Maps physical address [0 ~ mem_end] to
 	//   [LOADER_KERN_BASE ~ LOADER_KERN_BASE + mem_end].
-	for (uint64_t pa = 0; pa < mem_end; pa += PGSIZE) {
+	for (uint64_t pa = 0; pa < mem_end; ) {
 		uint64_t va = (uint64_t) ptov(pa);
 
+		if (!no_large_pages && pa != 0 && (pa & LARGE_PGMASK) == 0
+				&& pa + LARGE_PGSIZE <= mem_end
+				&& (va + LARGE_PGSIZE <= text_start || va >= text_end)) {
+			if (!pml4_set_large_page (pml4, va, pa, PTE_W))
+				PANIC ("paging_init: out of memory");
+			kmap_large_cnt++;
+			pa += LARGE_PGSIZE;
+			continue;
+		}
+
 		perm = PTE_P | PTE_W;
-		if ((uint64_t) &start <= va && va < (uint64_t) &_end_kernel_text)
+		if ((uint64_t) &start <= va && va < text_end)
 			perm &= ~PTE_W;
 
 		if ((pte = pml4e_walk (pml4, va, 1)) != NULL)
 			*pte = pa | perm;
+		kmap_small_cnt++;
+		pa += PGSIZE;
 	}
 
 	// reload cr3
 	pml4_activate(0);
+
+	kmap_cycles = rdtsc () - start_tsc;
 }
 
 /* Breaks the kernel command line into words and returns them as
@@ -221,11 +259,34 @@ parse_options (char **argv) {
 			random_init (atoi (value));
 		else if (!strcmp (name, "-mlfqs"))
 			thread_mlfqs = true;
+		else if (!strcmp (name, "-memleak"))
+			malloc_leak_check = true;
+		else if (!strcmp (name, "-nolargepage"))
+			no_large_pages = true;
+		else if (!strcmp (name, "-nopcid"))
+			pcid_disabled = true;
 #ifdef USERPROG
 		else if (!strcmp (name, "-ul"))
 			user_page_limit = atoi (value);
 		else if (!strcmp (name, "-threads-tests"))
 			thread_tests = true;
+#endif
+#ifdef VM
+		else if (!strcmp (name, "-thp"))
+			vm_thp_enabled = true;
+		else if (!strcmp (name, "-zswap"))
+			zswap_max_pages = atoi (value);
+		else if (!strcmp (name, "-ksm"))
+			vm_ksm_scan_rate = atoi (value);
+		else if (!strcmp (name, "-pfstat"))
+			vm_fault_report = true;
+		else if (!strcmp (name, "-rss")) {
+			vm_rss_limit = atoi (value);
+			if (vm_rss_limit != 0 && vm_rss_limit < VM_RSS_LIMIT_MIN)
+				PANIC ("-rss must be at least %d pages", VM_RSS_LIMIT_MIN);
+		}
+		else if (!strcmp (name, "-swap"))
+			parse_swap (value);
 #endif
 		else
 			PANIC ("unknown option `%s' (use -h for help)", name);
@@ -234,6 +295,25 @@ parse_options (char **argv) {
 	return argv;
 }
 
+#ifdef VM
+/* Adds the swap device named by SPEC, the value of -swap. */
+static void
+parse_swap (const char *spec) {
+	char buf[32], *save_ptr, *chan, *dev, *prio;
+
+	if (spec == NULL)
+		PANIC ("-swap needs a device (use -h for help)");
+	strlcpy (buf, spec, sizeof buf);
+	chan = strtok_r (buf, ":", &save_ptr);
+	dev = strtok_r (NULL, ":", &save_ptr);
+	prio = strtok_r (NULL, "", &save_ptr);
+	if (chan == NULL || dev == NULL
+			|| !anon_swap_add (atoi (chan), atoi (dev),
+				prio != NULL ? atoi (prio) : 0))
+		PANIC ("bad swap device `%s' (use -h for help)", spec);
+}
+#endif
+
 /* Runs the task specified in ARGV[1]. */
 static void
 run_task (char **argv) {
@@ -326,8 +406,26 @@ usage (void) {
 			"  -f                 Format file system disk during startup.\n"
 			"  -rs=SEED           Set random number seed to SEED.\n"
 			"  -mlfqs             Use multi-level feedback queue scheduler.\n"
+			"  -memleak           Report kernel blocks leaked by each process.\n"
+			"  -nolargepage       Map physical memory with 4 kB pages only.\n"
+			"  -nopcid            Flush the TLB on every address space switch.\n"
 #ifdef USERPROG
 			"  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+			"  -thp               Map aligned anonymous regions with 2 MB pages.\n"
+			"  -zswap=PAGES       Limit the compressed swap pool to PAGES pages.\n"
+			"  -ksm=PAGES         Merge identical anonymous pages, scanning\n"
+			"                     PAGES frames every 100 ms.\n"
+			"  -pfstat            Report each process's page faults at exit.\n"
+			"  -rss=PAGES         Limit each process to PAGES resident pages,\n"
+			"                     evicting its own pages beyond that.\n"
+			"  -swap=C:D[:PRIO]   Swap to disk hdC:D, before disks of lower\n"
+			"                     PRIO and striped with those of equal PRIO.\n"
+			"                     C and D are 0 or 1; hd0:1 (file system) and\n"
+			"                     hd1:0 (scratch) are refused, and hd0:0 (boot)\n"
+			"                     is free once booted.  May be repeated; the\n"
+			"                     default is hd1:1.\n"
 #endif
 			);
 	power_off ();
@@ -362,4 +460,12 @@ print_stats (void) {
 #ifdef USERPROG
 	exception_print_stats ();
 #endif
+#ifdef VM
+	vm_print_stats ();
+#endif
+	printf ("Kernel map: %zu 2 MB pages, %zu 4 kB pages in %llu cycles\n",
+			kmap_large_cnt, kmap_small_cnt, kmap_cycles);
+	pml4_print_stats ();
+	palloc_print_stats ();
+	malloc_print_stats ();
 }
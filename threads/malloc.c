@@ -7,6 +7,7 @@
 #include <string.h>
 #include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
 
 /* A simple implementation of malloc().
@@ -32,12 +33,26 @@
    because they're too big to fit in a single page with a
    descriptor.  We handle those by allocating contiguous pages
    with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   the beginning of the allocated block's arena header.
+
+   Every block is charged to a mem_tag.  Each tag has its own set
+   of descriptors, so an arena only ever holds blocks of one tag
+   and free() finds the tag through the arena's descriptor.  Big
+   blocks are charged to their tag by the page allocator as well.
+
+   With -memleak on the kernel command line, each block is
+   additionally prefixed by a `struct alloc_rec' that records its
+   owner and caller, and malloc_leak_report() lists the blocks a
+   thread still owns.  Blocks that join a structure shared by all
+   threads, such as the frame table or the page cache, outlive the
+   thread that happened to allocate them; malloc_disown() takes
+   them out of the report. */
 
 /* Descriptor. */
 struct desc {
 	size_t block_size;          /* Size of each element in bytes. */
 	size_t blocks_per_arena;    /* Number of blocks in an arena. */
+	enum mem_tag tag;           /* Tag charged for each block. */
 	struct list free_list;      /* List of free blocks. */
 	struct lock lock;           /* Lock. */
 };
@@ -57,10 +72,32 @@ struct block {
 	struct list_elem free_elem; /* Free list element. */
 };
 
+/* Leak-check record, prefixed to every block with -memleak. */
+struct alloc_rec {
+	struct list_elem elem;      /* Element in live_blocks. */
+	tid_t owner;                /* Thread that allocated the block. */
+	enum mem_tag tag;           /* Tag charged. */
+	size_t size;                /* Requested size in bytes. */
+	void *caller;               /* Return address of the allocator call. */
+};
+
 /* Our set of descriptors. */
-static struct desc descs[10];   /* Descriptors. */
-static size_t desc_cnt;         /* Number of descriptors. */
+static struct desc descs[MEM_TAG_CNT][10]; /* Descriptors per tag. */
+static size_t desc_cnt;         /* Number of descriptors per tag. */
+
+/* Block usage by tag. */
+static struct mem_usage block_usage[MEM_TAG_CNT];
 
+/* -memleak: track every live block? */
+bool malloc_leak_check;
+
+/* Live blocks when MALLOC_LEAK_CHECK is set. */
+static struct list live_blocks;
+static struct lock live_lock;
+
+static void *do_malloc (size_t size, enum mem_tag, void *caller);
+static void *block_alloc (size_t size, enum mem_tag);
+static void block_free (void *);
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
 
@@ -68,39 +105,82 @@ static struct block *arena_to_block (struct arena *, size_t idx);
 void
 malloc_init (void) {
 	size_t block_size;
-
-	for (block_size = 16; block_size < PGSIZE / 2; block_size *= 2) {
-		struct desc *d = &descs[desc_cnt++];
-		ASSERT (desc_cnt <= sizeof descs / sizeof *descs);
-		d->block_size = block_size;
-		d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
-		list_init (&d->free_list);
-		lock_init (&d->lock);
+	enum mem_tag tag;
+
+	for (tag = 0; tag < MEM_TAG_CNT; tag++) {
+		desc_cnt = 0;
+		for (block_size = 16; block_size < PGSIZE / 2; block_size *= 2) {
+			struct desc *d = &descs[tag][desc_cnt++];
+			ASSERT (desc_cnt <= sizeof descs[tag] / sizeof *descs[tag]);
+			d->block_size = block_size;
+			d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
+			d->tag = tag;
+			list_init (&d->free_list);
+			lock_init (&d->lock);
+		}
 	}
+	list_init (&live_blocks);
+	lock_init (&live_lock);
 }
 
 /* Obtains and returns a new block of at least SIZE bytes.
    Returns a null pointer if memory is not available. */
 void *
 malloc (size_t size) {
-	struct desc *d;
-	struct block *b;
-	struct arena *a;
+	return do_malloc (size, MEM_MISC, __builtin_return_address (0));
+}
+
+/* Like malloc(), but charges the block to TAG. */
+void *
+malloc_tagged (size_t size, enum mem_tag tag) {
+	return do_malloc (size, tag, __builtin_return_address (0));
+}
+
+/* Implements malloc_tagged(), recording CALLER for the leak
+   check. */
+static void *
+do_malloc (size_t size, enum mem_tag tag, void *caller) {
+	struct alloc_rec *r;
+
+	ASSERT (tag < MEM_TAG_CNT);
 
 	/* A null pointer satisfies a request for 0 bytes. */
 	if (size == 0)
 		return NULL;
 
+	if (!malloc_leak_check)
+		return block_alloc (size, tag);
+
+	r = block_alloc (sizeof *r + size, tag);
+	if (r == NULL)
+		return NULL;
+	r->owner = thread_tid ();
+	r->tag = tag;
+	r->size = size;
+	r->caller = caller;
+	lock_acquire (&live_lock);
+	list_push_back (&live_blocks, &r->elem);
+	lock_release (&live_lock);
+	return r + 1;
+}
+
+/* Obtains a block of at least SIZE bytes charged to TAG. */
+static void *
+block_alloc (size_t size, enum mem_tag tag) {
+	struct desc *d;
+	struct block *b;
+	struct arena *a;
+
 	/* Find the smallest descriptor that satisfies a SIZE-byte
 	   request. */
-	for (d = descs; d < descs + desc_cnt; d++)
+	for (d = descs[tag]; d < descs[tag] + desc_cnt; d++)
 		if (d->block_size >= size)
 			break;
-	if (d == descs + desc_cnt) {
+	if (d == descs[tag] + desc_cnt) {
 		/* SIZE is too big for any descriptor.
 		   Allocate enough pages to hold SIZE plus an arena. */
 		size_t page_cnt = DIV_ROUND_UP (size + sizeof *a, PGSIZE);
-		a = palloc_get_multiple (0, page_cnt);
+		a = palloc_get_multiple (PAL_TAG (tag), page_cnt);
 		if (a == NULL)
 			return NULL;
 
@@ -109,6 +189,7 @@ malloc (size_t size) {
 		a->magic = ARENA_MAGIC;
 		a->desc = NULL;
 		a->free_cnt = page_cnt;
+		mem_usage_charge (&block_usage[tag], PGSIZE * page_cnt);
 		return a + 1;
 	}
 
@@ -119,7 +200,7 @@ malloc (size_t size) {
 		size_t i;
 
 		/* Allocate a page. */
-		a = palloc_get_page (0);
+		a = palloc_get_page (PAL_TAG (MEM_ARENA));
 		if (a == NULL) {
 			lock_release (&d->lock);
 			return NULL;
@@ -140,6 +221,7 @@ malloc (size_t size) {
 	a = block_to_arena (b);
 	a->free_cnt--;
 	lock_release (&d->lock);
+	mem_usage_charge (&block_usage[tag], d->block_size);
 	return b;
 }
 
@@ -156,7 +238,24 @@ calloc (size_t a, size_t b) {
 		return NULL;
 
 	/* Allocate and zero memory. */
-	p = malloc (size);
+	p = do_malloc (size, MEM_MISC, __builtin_return_address (0));
+	if (p != NULL)
+		memset (p, 0, size);
+
+	return p;
+}
+
+/* Like calloc(), but charges the block to TAG. */
+void *
+calloc_tagged (size_t a, size_t b, enum mem_tag tag) {
+	void *p;
+	size_t size;
+
+	size = a * b;
+	if (size < a || size < b)
+		return NULL;
+
+	p = do_malloc (size, tag, __builtin_return_address (0));
 	if (p != NULL)
 		memset (p, 0, size);
 
@@ -167,10 +266,27 @@ calloc (size_t a, size_t b) {
 static size_t
 block_size (void *block) {
 	struct block *b = block;
-	struct arena *a = block_to_arena (b);
-	struct desc *d = a->desc;
+	struct arena *a;
+	struct desc *d;
+
+	if (malloc_leak_check)
+		b = (struct block *) ((struct alloc_rec *) block - 1);
+	a = block_to_arena (b);
+	d = a->desc;
+
+	return (d != NULL ? d->block_size : PGSIZE * a->free_cnt - pg_ofs (b))
+		- ((uint8_t *) block - (uint8_t *) b);
+}
+
+/* Returns the tag charged for BLOCK. */
+static enum mem_tag
+block_tag (void *block) {
+	struct arena *a;
 
-	return d != NULL ? d->block_size : PGSIZE * a->free_cnt - pg_ofs (block);
+	if (malloc_leak_check)
+		return ((struct alloc_rec *) block - 1)->tag;
+	a = block_to_arena (block);
+	return a->desc != NULL ? a->desc->tag : palloc_page_tag (a);
 }
 
 /* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
@@ -185,7 +301,9 @@ realloc (void *old_block, size_t new_size) {
 		free (old_block);
 		return NULL;
 	} else {
-		void *new_block = malloc (new_size);
+		enum mem_tag tag = old_block != NULL ? block_tag (old_block) : MEM_MISC;
+		void *new_block = do_malloc (new_size, tag,
+				__builtin_return_address (0));
 		if (old_block != NULL && new_block != NULL) {
 			size_t old_size = block_size (old_block);
 			size_t min_size = new_size < old_size ? new_size : old_size;
@@ -200,44 +318,117 @@ realloc (void *old_block, size_t new_size) {
    malloc(), calloc(), or realloc(). */
 void
 free (void *p) {
-	if (p != NULL) {
-		struct block *b = p;
-		struct arena *a = block_to_arena (b);
-		struct desc *d = a->desc;
+	if (p != NULL && malloc_leak_check) {
+		struct alloc_rec *r = (struct alloc_rec *) p - 1;
+
+		lock_acquire (&live_lock);
+		list_remove (&r->elem);
+		lock_release (&live_lock);
+		block_free (r);
+	} else if (p != NULL)
+		block_free (p);
+}
+
+/* Returns block P to its descriptor or, for a big block, to the
+   page allocator. */
+static void
+block_free (void *p) {
+	struct block *b = p;
+	struct arena *a = block_to_arena (b);
+	struct desc *d = a->desc;
 
-		if (d != NULL) {
-			/* It's a normal block.  We handle it here. */
+	if (d != NULL) {
+		/* It's a normal block.  We handle it here. */
+		mem_usage_uncharge (&block_usage[d->tag], d->block_size);
 
 #ifndef NDEBUG
-			/* Clear the block to help detect use-after-free bugs. */
-			memset (b, 0xcc, d->block_size);
+		/* Clear the block to help detect use-after-free bugs. */
+		memset (b, 0xcc, d->block_size);
 #endif
 
-			lock_acquire (&d->lock);
+		lock_acquire (&d->lock);
 
-			/* Add block to free list. */
-			list_push_front (&d->free_list, &b->free_elem);
+		/* Add block to free list. */
+		list_push_front (&d->free_list, &b->free_elem);
 
-			/* If the arena is now entirely unused, free it. */
-			if (++a->free_cnt >= d->blocks_per_arena) {
-				size_t i;
+		/* If the arena is now entirely unused, free it. */
+		if (++a->free_cnt >= d->blocks_per_arena) {
+			size_t i;
 
-				ASSERT (a->free_cnt == d->blocks_per_arena);
-				for (i = 0; i < d->blocks_per_arena; i++) {
-					struct block *b = arena_to_block (a, i);
-					list_remove (&b->free_elem);
-				}
-				palloc_free_page (a);
+			ASSERT (a->free_cnt == d->blocks_per_arena);
+			for (i = 0; i < d->blocks_per_arena; i++) {
+				struct block *b = arena_to_block (a, i);
+				list_remove (&b->free_elem);
 			}
-
-			lock_release (&d->lock);
-		} else {
-			/* It's a big block.  Free its pages. */
-			palloc_free_multiple (a, a->free_cnt);
-			return;
+			palloc_free_page (a);
 		}
+
+		lock_release (&d->lock);
+	} else {
+		/* It's a big block.  Free its pages, crediting the tag the
+		   page allocator charged them to. */
+		mem_usage_uncharge (&block_usage[palloc_page_tag (a)],
+				PGSIZE * a->free_cnt);
+		palloc_free_multiple (a, a->free_cnt);
+	}
+}
+
+/* Makes block P, which must have been previously allocated with
+   malloc(), calloc(), or realloc(), belong to no thread, for a
+   block that goes into a structure shared by all threads rather
+   than one its allocator is expected to release. */
+void
+malloc_disown (void *p) {
+	if (p != NULL && malloc_leak_check) {
+		struct alloc_rec *r = (struct alloc_rec *) p - 1;
+
+		lock_acquire (&live_lock);
+		r->owner = TID_ERROR;
+		lock_release (&live_lock);
 	}
 }
+
+/* Prints block usage by tag. */
+void
+malloc_print_stats (void) {
+	printf ("Malloc:\n");
+	for (enum mem_tag tag = 0; tag < MEM_TAG_CNT; tag++) {
+		const struct mem_usage *u = &block_usage[tag];
+		if (u->allocs == 0)
+			continue;
+		printf ("  %-12s %8zu B live %8zu B peak %8llu allocs %8llu frees\n",
+				mem_tag_name (tag), u->live, u->peak, u->allocs, u->frees);
+	}
+}
+
+/* Lists the blocks still owned by thread TID.  Called with
+   -memleak once a process has released its resources, so
+   anything reported here was leaked. */
+void
+malloc_leak_report (tid_t tid) {
+	struct list_elem *e;
+	size_t cnt = 0, bytes = 0;
+
+	if (!malloc_leak_check)
+		return;
+
+	lock_acquire (&live_lock);
+	for (e = list_begin (&live_blocks); e != list_end (&live_blocks);
+			e = list_next (e)) {
+		struct alloc_rec *r = list_entry (e, struct alloc_rec, elem);
+		if (r->owner != tid)
+			continue;
+		if (cnt++ == 0)
+			printf ("Leak check: tid %d still owns:\n", tid);
+		printf ("  %p: %zu bytes, %s, allocated at %p\n",
+				r + 1, r->size, mem_tag_name (r->tag), r->caller);
+		bytes += r->size;
+	}
+	lock_release (&live_lock);
+
+	if (cnt > 0)
+		printf ("Leak check: tid %d: %zu blocks, %zu bytes\n", tid, cnt, bytes);
+}
 
 /* Returns the arena that block B is inside. */
 static struct arena *
@@ -1,13 +1,182 @@
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdio.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/mmu.h"
 #include "intrinsic.h"
 
+/* Process-context identifiers.
+
+   With PCIDs, each TLB entry is tagged with the PCID in CR3 when
+   it was loaded, so a switch to another address space need not
+   flush the TLB: its entries stay cached, and the old ones are
+   not used.  base_pml4 has PCID 0; every other pml4 is given one
+   of the rest when it is first activated, and records it in its
+   own PCID_SLOT entry, which is never present and so is ignored
+   by the CPU.
+
+   PCIDs are handed out in order and never freed.  When they run
+   out, a new generation begins: every pml4 of an older generation
+   gets a new PCID when it is next activated.  A pml4 loads CR3
+   without the no-flush bit the first time it runs with a PCID,
+   which drops whatever its previous holder left in the TLB.
+
+   A change to a pml4 that is not active is invalidated with
+   INVPCID if the CPU has it, or else by flushing that pml4's PCID
+   when it is next activated. */
+
+#define CR3_NOFLUSH (1ULL << 63)    /* Keep the PCID's TLB entries. */
+#define CR4_PCIDE (1 << 17)         /* Enable PCIDs. */
+#define CPUID_1_ECX_PCID (1 << 17)
+#define CPUID_7_EBX_INVPCID (1 << 10)
+#define INVPCID_ADDR 0              /* Invalidate one address. */
+#define INVPCID_CONTEXT 1           /* Invalidate a whole PCID. */
+
+#define PCID_CNT 4096
+#define PCID_SLOT 511
+
+/* A PCID_SLOT entry: generation, PCID, and a flag to flush the
+ * PCID on the next activation.  Bit 0, the present bit, is 0. */
+#define SLOT_STALE 0x2
+#define SLOT_PCID(slot) (((slot) >> 4) & (PCID_CNT - 1))
+#define SLOT_GEN(slot) ((slot) >> 16)
+#define SLOT_MAKE(gen, pcid) ((gen) << 16 | (uint64_t) (pcid) << 4)
+
+bool pcid_disabled;                 /* -nopcid. */
+static bool pcid_enabled;
+static bool invpcid_ok;
+static uint64_t pcid_gen = 1;
+static unsigned pcid_next = 1;
+
+static unsigned long long switch_cnt;       /* CR3 loads. */
+static unsigned long long noflush_cnt;      /* ...that kept the TLB. */
+static unsigned long long gen_cnt;          /* Generations begun. */
+static unsigned long long invpcid_cnt;      /* Remote invalidations. */
+static unsigned long long deferred_cnt;     /* ...left to activation. */
+
+/* Turns on PCIDs if the CPU has them, unless -nopcid. */
+void
+pml4_pcid_init (void) {
+	uint32_t a, b, c, d;
+
+	ASSERT (base_pml4[PCID_SLOT] == 0);
+	if (pcid_disabled)
+		return;
+	cpuid (1, 0, &a, &b, &c, &d);
+	if (!(c & CPUID_1_ECX_PCID))
+		return;
+	cpuid (0, 0, &a, &b, &c, &d);
+	if (a >= 7) {
+		cpuid (7, 0, &a, &b, &c, &d);
+		invpcid_ok = (b & CPUID_7_EBX_INVPCID) != 0;
+	}
+
+	/* CR3 must have PCID 0 when PCIDs are turned on. */
+	lcr3 (vtop (base_pml4));
+	lcr4 (rcr4 () | CR4_PCIDE);
+	pcid_enabled = true;
+}
+
+/* Returns the PCID bits to load into CR3 with PML4: its PCID,
+ * assigning one first if need be, and CR3_NOFLUSH unless its TLB
+ * entries may be stale.  Must be called with interrupts off. */
+static uint64_t
+pcid_activate (uint64_t *pml4) {
+	uint64_t slot = pml4[PCID_SLOT];
+	unsigned pcid;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	if (pml4 == base_pml4)
+		return CR3_NOFLUSH;
+	if (SLOT_GEN (slot) == pcid_gen) {
+		pcid = SLOT_PCID (slot);
+		if (!(slot & SLOT_STALE))
+			return pcid | CR3_NOFLUSH;
+	} else {
+		if (pcid_next == PCID_CNT) {
+			pcid_gen++;
+			pcid_next = 1;
+			gen_cnt++;
+		}
+		pcid = pcid_next++;
+	}
+	pml4[PCID_SLOT] = SLOT_MAKE (pcid_gen, pcid);
+	return pcid;
+}
+
+/* Invalidates the TLB entry for VA in PML4, whether or not PML4 is
+ * active. */
+static void
+tlb_invalidate (uint64_t *pml4, uint64_t va) {
+	enum intr_level old_level;
+	uint64_t slot;
+
+	if (PTE_ADDR (rcr3 ()) == vtop (pml4)) {
+		invlpg (va);
+		return;
+	}
+	if (!pcid_enabled)
+		return;
+
+	/* Without PCIDs, the switch to PML4 would flush the TLB. */
+	old_level = intr_disable ();
+	slot = pml4[PCID_SLOT];
+	if (SLOT_GEN (slot) == pcid_gen && !(slot & SLOT_STALE)) {
+		if (invpcid_ok) {
+			invpcid (INVPCID_ADDR, SLOT_PCID (slot), va);
+			invpcid_cnt++;
+		} else {
+			pml4[PCID_SLOT] = slot | SLOT_STALE;
+			deferred_cnt++;
+		}
+	}
+	intr_set_level (old_level);
+}
+
+/* Invalidates every TLB entry of PML4. */
+static void
+tlb_flush_all (uint64_t *pml4) {
+	enum intr_level old_level;
+	uint64_t slot;
+
+	if (PTE_ADDR (rcr3 ()) == vtop (pml4)) {
+		/* Reloading CR3 without CR3_NOFLUSH flushes its PCID. */
+		lcr3 (rcr3 ());
+		return;
+	}
+	if (!pcid_enabled)
+		return;
+
+	old_level = intr_disable ();
+	slot = pml4[PCID_SLOT];
+	if (SLOT_GEN (slot) == pcid_gen && !(slot & SLOT_STALE)) {
+		if (invpcid_ok) {
+			invpcid (INVPCID_CONTEXT, SLOT_PCID (slot), 0);
+			invpcid_cnt++;
+		} else {
+			pml4[PCID_SLOT] = slot | SLOT_STALE;
+			deferred_cnt++;
+		}
+	}
+	intr_set_level (old_level);
+}
+
+/* Prints address space switch statistics. */
+void
+pml4_print_stats (void) {
+	if (!pcid_enabled)
+		return;
+	printf ("PCID: %llu switches, %llu without flush, %llu generations, "
+			"%llu invpcid, %llu deferred flushes\n",
+			switch_cnt, noflush_cnt, gen_cnt, invpcid_cnt, deferred_cnt);
+}
+
 static uint64_t *
 pgdir_walk (uint64_t *pdp, const uint64_t va, int create) {
 	int idx = PDX (va);
@@ -15,7 +184,7 @@ pgdir_walk (uint64_t *pdp, const uint64_t va, int create) {
 		uint64_t *pte = (uint64_t *) pdp[idx];
 		if (!((uint64_t) pte & PTE_P)) {
 			if (create) {
-				uint64_t *new_page = palloc_get_page (PAL_ZERO);
+				uint64_t *new_page = palloc_get_page (PAL_ZERO | PAL_TAG (MEM_PGTBL));
 				if (new_page)
 					pdp[idx] = vtop (new_page) | PTE_U | PTE_W | PTE_P;
 				else
@@ -23,6 +192,9 @@ pgdir_walk (uint64_t *pdp, const uint64_t va, int create) {
 			} else
 				return NULL;
 		}
+		/* A large page has no page table; its PDE is the entry. */
+		if (pdp[idx] & PTE_PS)
+			return &pdp[idx];
 		return (uint64_t *) ptov (PTE_ADDR (pdp[idx]) + 8 * PTX (va));
 	}
 	return NULL;
@@ -37,7 +209,7 @@ pdpe_walk (uint64_t *pdpe, const uint64_t va, int create) {
 		uint64_t *pde = (uint64_t *) pdpe[idx];
 		if (!((uint64_t) pde & PTE_P)) {
 			if (create) {
-				uint64_t *new_page = palloc_get_page (PAL_ZERO);
+				uint64_t *new_page = palloc_get_page (PAL_ZERO | PAL_TAG (MEM_PGTBL));
 				if (new_page) {
 					pdpe[idx] = vtop (new_page) | PTE_U | PTE_W | PTE_P;
 					allocated = 1;
@@ -60,7 +232,9 @@ pdpe_walk (uint64_t *pdpe, const uint64_t va, int create) {
  * If PML4E does not have a page table for VADDR, behavior depends
  * on CREATE.  If CREATE is true, then a new page table is
  * created and a pointer into it is returned.  Otherwise, a null
- * pointer is returned. */
+ * pointer is returned.
+ * If VADDR lies in a large page, the page-directory entry that
+ * maps it is returned instead; it has PTE_PS set. */
 uint64_t *
 pml4e_walk (uint64_t *pml4e, const uint64_t va, int create) {
 	uint64_t *pte = NULL;
@@ -70,7 +244,7 @@ pml4e_walk (uint64_t *pml4e, const uint64_t va, int create) {
 		uint64_t *pdpe = (uint64_t *) pml4e[idx];
 		if (!((uint64_t) pdpe & PTE_P)) {
 			if (create) {
-				uint64_t *new_page = palloc_get_page (PAL_ZERO);
+				uint64_t *new_page = palloc_get_page (PAL_ZERO | PAL_TAG (MEM_PGTBL));
 				if (new_page) {
 					pml4e[idx] = vtop (new_page) | PTE_U | PTE_W | PTE_P;
 					allocated = 1;
@@ -94,12 +268,89 @@ pml4e_walk (uint64_t *pml4e, const uint64_t va, int create) {
  * allocation fails. */
 uint64_t *
 pml4_create (void) {
-	uint64_t *pml4 = palloc_get_page (0);
+	uint64_t *pml4 = palloc_get_page (PAL_TAG (MEM_PGTBL));
 	if (pml4)
 		memcpy (pml4, base_pml4, PGSIZE);
 	return pml4;
 }
 
+/* Returns the kernel virtual address of the table that *ENTRY
+ * points to, allocating an empty one if ENTRY is not present.
+ * Returns a null pointer if memory allocation fails. */
+static uint64_t *
+table_get (uint64_t *entry) {
+	if (!(*entry & PTE_P)) {
+		uint64_t *new_page = palloc_get_page (PAL_ZERO | PAL_TAG (MEM_PGTBL));
+		if (new_page == NULL)
+			return NULL;
+		*entry = vtop (new_page) | PTE_U | PTE_W | PTE_P;
+	}
+	return ptov (PTE_ADDR (*entry));
+}
+
+/* Maps the 2 MB large page at physical address PA at virtual
+ * address VA in PML4 with a single page-directory entry, adding
+ * PTE flags FLAGS.  VA and PA must be LARGE_PGSIZE aligned and VA
+ * must not already be mapped.  Returns true if successful, false
+ * if memory allocation failed. */
+bool
+pml4_set_large_page (uint64_t *pml4, uint64_t va, uint64_t pa,
+		uint64_t flags) {
+	uint64_t *pdpe, *pgdir;
+
+	ASSERT ((va & LARGE_PGMASK) == 0);
+	ASSERT ((pa & LARGE_PGMASK) == 0);
+
+	pdpe = table_get (&pml4[PML4 (va)]);
+	if (pdpe == NULL)
+		return false;
+	pgdir = table_get (&pdpe[PDPE (va)]);
+	if (pgdir == NULL)
+		return false;
+
+	if (pgdir[PDX (va)] & PTE_P) {
+		/* A page table may be left over from 4 kB mappings that
+		 * have all been cleared since.  Reclaim it; refuse if it
+		 * still maps anything. */
+		uint64_t *pt;
+
+		if (pgdir[PDX (va)] & PTE_PS)
+			return false;
+		pt = ptov (PTE_ADDR (pgdir[PDX (va)]));
+		for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++)
+			if (pt[i] & PTE_P)
+				return false;
+		palloc_free_page (pt);
+	}
+	pgdir[PDX (va)] = pa | flags | PTE_PS | PTE_P;
+	tlb_invalidate (pml4, va);
+	return true;
+}
+
+/* Replaces the large page mapping VA in PML4 by a page table of
+ * 4 kB PTEs that map the same frames with the same flags, so that
+ * they can be changed one at a time.  Returns true if successful,
+ * false if memory allocation failed. */
+bool
+pml4_split_large_page (uint64_t *pml4, uint64_t va) {
+	uint64_t *pde = pml4e_walk (pml4, va, false);
+	uint64_t *pt, pa, flags;
+
+	ASSERT (pde != NULL && (*pde & PTE_P) && (*pde & PTE_PS));
+
+	pt = palloc_get_page (PAL_TAG (MEM_PGTBL));
+	if (pt == NULL)
+		return false;
+	pa = PTE_ADDR (*pde) & ~LARGE_PGMASK;
+	flags = *pde & PTE_FLAGS & ~PTE_PS;
+	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++)
+		pt[i] = (pa + i * PGSIZE) | flags;
+	*pde = vtop (pt) | PTE_U | PTE_W | PTE_P;
+
+	tlb_invalidate (pml4, va & ~LARGE_PGMASK);
+	return true;
+}
+
 static bool
 pt_for_each (uint64_t *pt, pte_for_each_func *func, void *aux,
 		unsigned pml4_index, unsigned pdp_index, unsigned pdx_index) {
@@ -122,10 +373,18 @@ pgdir_for_each (uint64_t *pdp, pte_for_each_func *func, void *aux,
 		unsigned pml4_index, unsigned pdp_index) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pte) & PTE_P)
-			if (!pt_for_each ((uint64_t *) PTE_ADDR (pte), func, aux,
-					pml4_index, pdp_index, i))
+		if (!(((uint64_t) pte) & PTE_P))
+			continue;
+		if (pdp[i] & PTE_PS) {
+			/* Large page: FUNC sees the PDE itself. */
+			void *va = (void *) (((uint64_t) pml4_index << PML4SHIFT) |
+								 ((uint64_t) pdp_index << PDPESHIFT) |
+								 ((uint64_t) i << PDXSHIFT));
+			if (!func (&pdp[i], va, aux))
 				return false;
+		} else if (!pt_for_each ((uint64_t *) PTE_ADDR (pte), func, aux,
+					pml4_index, pdp_index, i))
+			return false;
 	}
 	return true;
 }
@@ -169,7 +428,12 @@ static void
 pgdir_destroy (uint64_t *pdp) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pte) & PTE_P)
+		if (!(((uint64_t) pte) & PTE_P))
+			continue;
+		if (pdp[i] & PTE_PS)
+			palloc_free_multiple ((void *) PTE_ADDR (pte),
+					LARGE_PGSIZE / PGSIZE);
+		else
 			pt_destroy (PTE_ADDR (pte));
 	}
 	palloc_free_page ((void *) pdp);
@@ -200,10 +464,27 @@ pml4_destroy (uint64_t *pml4) {
 }
 
 /* Loads page directory PD into the CPU's page directory base
- * register. */
+ * register.  With PCIDs, the TLB entries of other address spaces
+ * are kept. */
 void
 pml4_activate (uint64_t *pml4) {
-	lcr3 (vtop (pml4 ? pml4 : base_pml4));
+	enum intr_level old_level;
+	uint64_t cr3;
+
+	if (pml4 == NULL)
+		pml4 = base_pml4;
+	if (!pcid_enabled) {
+		lcr3 (vtop (pml4));
+		return;
+	}
+
+	old_level = intr_disable ();
+	cr3 = vtop (pml4) | pcid_activate (pml4);
+	switch_cnt++;
+	if (cr3 & CR3_NOFLUSH)
+		noflush_cnt++;
+	lcr3 (cr3);
+	intr_set_level (old_level);
 }
 
 /* Looks up the physical address that corresponds to user virtual
@@ -216,8 +497,11 @@ pml4_get_page (uint64_t *pml4, const void *uaddr) {
 
 	uint64_t *pte = pml4e_walk (pml4, (uint64_t) uaddr, 0);
 
-	if (pte && (*pte & PTE_P))
+	if (pte && (*pte & PTE_P)) {
+		if (*pte & PTE_PS)
+			return ptov (PTE_ADDR (*pte)) + ((uint64_t) uaddr & LARGE_PGMASK);
 		return ptov (PTE_ADDR (*pte)) + pg_ofs (uaddr);
+	}
 	return NULL;
 }
 
@@ -257,8 +541,7 @@ pml4_clear_page (uint64_t *pml4, void *upage) {
 
 	if (pte != NULL && (*pte & PTE_P) != 0) {
 		*pte &= ~PTE_P;
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) upage);
+		tlb_invalidate (pml4, (uint64_t) upage);
 	}
 }
 
@@ -283,8 +566,7 @@ pml4_set_dirty (uint64_t *pml4, const void *vpage, bool dirty) {
 		else
 			*pte &= ~(uint32_t) PTE_D;
 
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) vpage);
+		tlb_invalidate (pml4, (uint64_t) vpage);
 	}
 }
 
@@ -309,7 +591,288 @@ pml4_set_accessed (uint64_t *pml4, const void *vpage, bool accessed) {
 		else
 			*pte &= ~(uint32_t) PTE_A;
 
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) vpage);
+		tlb_invalidate (pml4, (uint64_t) vpage);
+	}
+}
+
+/* Range operations.
+
+   These act on every page of a range of user virtual addresses
+   while walking the page table tree once, rather than once per
+   page, and gather the TLB invalidations they need into one
+   batch, which becomes a flush of the whole address space when
+   it grows past TLB_BATCH_MAX pages. */
+
+#define TLB_BATCH_MAX 32
+
+struct tlb_batch {
+	uint64_t *pml4;
+	size_t cnt;                 /* Pages to invalidate. */
+	uint64_t va[TLB_BATCH_MAX]; /* Their addresses, if CNT fits. */
+	uint64_t *free_list;        /* Empty tables to free after the flush,
+	                               linked through their first entry. */
+	bool free_empty;            /* Unlink tables that become empty? */
+};
+
+static void
+tlb_batch_init (struct tlb_batch *b, uint64_t *pml4, bool free_empty) {
+	b->pml4 = pml4;
+	b->cnt = 0;
+	b->free_list = NULL;
+	b->free_empty = free_empty;
+}
+
+static void
+tlb_batch_add (struct tlb_batch *b, uint64_t va) {
+	if (b->cnt < TLB_BATCH_MAX)
+		b->va[b->cnt] = va;
+	b->cnt++;
+}
+
+/* Carries out the invalidations in B, then frees the tables that
+ * were unlinked, which the CPU may have cached until now. */
+static void
+tlb_batch_finish (struct tlb_batch *b) {
+	if (b->cnt > TLB_BATCH_MAX || (b->free_list != NULL && b->cnt == 0))
+		tlb_flush_all (b->pml4);
+	else
+		for (size_t i = 0; i < b->cnt; i++)
+			tlb_invalidate (b->pml4, b->va[i]);
+
+	while (b->free_list != NULL) {
+		uint64_t *table = b->free_list;
+		b->free_list = (uint64_t *) table[0];
+		palloc_free_page (table);
 	}
 }
+
+static bool
+table_empty (const uint64_t *table) {
+	for (unsigned i = 0; i < PGSIZE / sizeof (uint64_t); i++)
+		if (table[i] != 0)
+			return false;
+	return true;
+}
+
+typedef bool range_func (uint64_t *pte, uint64_t va, void *aux);
+
+static const uint64_t level_shift[] = {
+	PML4SHIFT, PDPESHIFT, PDXSHIFT, PTXSHIFT
+};
+
+/* Calls FUNC for each nonzero entry of TABLE, at LEVEL 0 for a
+ * pml4 down to 3 for a page table, and of the tables below it,
+ * that maps part of [START, END).  A large page is one entry, at
+ * level 2, and is visited if the range overlaps it.  Stops and
+ * returns false if FUNC does. */
+static bool
+range_walk (uint64_t *table, int level, uint64_t start, uint64_t end,
+		range_func *func, void *aux, struct tlb_batch *b) {
+	uint64_t span = 1ULL << level_shift[level];
+	bool ok = true;
+
+	for (uint64_t va = start; va < end && ok; ) {
+		uint64_t base = va & ~(span - 1);
+		uint64_t lim = base + span < end ? base + span : end;
+		uint64_t *e = &table[(va >> level_shift[level]) & 0x1ff];
+
+		if (level == 3 || (*e & PTE_PS)) {
+			if (*e != 0)
+				ok = func (e, base, aux);
+		} else if (*e & PTE_P) {
+			uint64_t *sub = ptov (PTE_ADDR (*e));
+
+			ok = range_walk (sub, level + 1, va, lim, func, aux, b);
+			if (b != NULL && b->free_empty && table_empty (sub)) {
+				*e = 0;
+				sub[0] = (uint64_t) b->free_list;
+				b->free_list = sub;
+			}
+		}
+		va = lim;
+	}
+	return ok;
+}
+
+/* Checks that [START, END) is a page-aligned user range. */
+static void
+check_range (const void *start, const void *end) {
+	ASSERT (pg_ofs (start) == 0 && pg_ofs (end) == 0);
+	ASSERT (start <= end);
+	ASSERT (end == start || is_user_vaddr ((const uint8_t *) end - 1));
+}
+
+/* Maps the CNT user pages starting at UPAGE in PML4 to the frames
+ * at kernel virtual addresses KPAGES[0] through KPAGES[CNT - 1],
+ * read/write if RW, read-only otherwise, as pml4_set_page() does
+ * for one page.  Returns true if successful, false if memory
+ * allocation failed, in which case some of the pages may have been
+ * mapped. */
+bool
+pml4_map_range (uint64_t *pml4, void *upage, void **kpages, size_t cnt,
+		bool rw) {
+	uint64_t va = (uint64_t) upage;
+	size_t i = 0;
+
+	check_range (upage, (uint8_t *) upage + cnt * PGSIZE);
+	ASSERT (pml4 != base_pml4);
+
+	while (i < cnt) {
+		uint64_t *pte = pml4e_walk (pml4, va, 1);
+
+		if (pte == NULL)
+			return false;
+		ASSERT (!(*pte & PTE_PS));
+		do {
+			ASSERT (pg_ofs (kpages[i]) == 0);
+			*pte++ = vtop (kpages[i]) | PTE_P | (rw ? PTE_W : 0) | PTE_U;
+			va += PGSIZE;
+			i++;
+		} while (i < cnt && PTX (va) != 0);
+	}
+	return true;
+}
+
+static bool
+clear_pte (uint64_t *pte, uint64_t va, void *b) {
+	if (*pte & PTE_P) {
+		*pte &= ~PTE_P;
+		tlb_batch_add (b, va);
+	}
+	return true;
+}
+
+/* Marks every page in [START, END) not present in PML4, keeping
+ * the other bits of their entries, as pml4_clear_page() does for
+ * one page. */
+void
+pml4_clear_range (uint64_t *pml4, void *start, void *end) {
+	struct tlb_batch b;
+
+	check_range (start, end);
+	tlb_batch_init (&b, pml4, false);
+	range_walk (pml4, 0, (uint64_t) start, (uint64_t) end, clear_pte, &b, &b);
+	tlb_batch_finish (&b);
+}
+
+static bool
+unmap_pte (uint64_t *pte, uint64_t va, void *b) {
+	if (*pte & PTE_P)
+		tlb_batch_add (b, va);
+	*pte = 0;
+	return true;
+}
+
+/* Removes every mapping in [START, END) from PML4, along with
+ * what their entries recorded, and frees the page tables left
+ * empty.  The frames are not freed.  Large pages must lie wholly
+ * inside the range. */
+void
+pml4_unmap_range (uint64_t *pml4, void *start, void *end) {
+	struct tlb_batch b;
+
+	check_range (start, end);
+	ASSERT (pml4 != base_pml4);
+	tlb_batch_init (&b, pml4, true);
+	range_walk (pml4, 0, (uint64_t) start, (uint64_t) end, unmap_pte, &b, &b);
+	tlb_batch_finish (&b);
+}
+
+struct protect_aux {
+	struct tlb_batch b;
+	bool rw;
+};
+
+static bool
+protect_pte (uint64_t *pte, uint64_t va, void *aux_) {
+	struct protect_aux *aux = aux_;
+	uint64_t old = *pte;
+
+	if (aux->rw)
+		*pte |= PTE_W;
+	else
+		*pte &= ~PTE_W;
+	if (*pte != old && (old & PTE_P))
+		tlb_batch_add (&aux->b, va);
+	return true;
+}
+
+/* Makes the pages mapped in [START, END) of PML4 read/write if
+ * RW, read-only otherwise. */
+void
+pml4_protect_range (uint64_t *pml4, void *start, void *end, bool rw) {
+	struct protect_aux aux;
+
+	check_range (start, end);
+	tlb_batch_init (&aux.b, pml4, false);
+	aux.rw = rw;
+	range_walk (pml4, 0, (uint64_t) start, (uint64_t) end, protect_pte,
+			&aux, &aux.b);
+	tlb_batch_finish (&aux.b);
+}
+
+struct dirty_aux {
+	struct tlb_batch b;
+	bool clear;
+	bool dirty;
+};
+
+static bool
+dirty_pte (uint64_t *pte, uint64_t va, void *aux_) {
+	struct dirty_aux *aux = aux_;
+
+	if (!(*pte & PTE_D))
+		return true;
+	aux->dirty = true;
+	if (!aux->clear)
+		return false;
+	*pte &= ~PTE_D;
+	if (*pte & PTE_P)
+		tlb_batch_add (&aux->b, va);
+	return true;
+}
+
+/* Returns true if any page in [START, END) of PML4 is dirty.  If
+ * CLEAR, also clears the dirty bits of all of them. */
+bool
+pml4_is_dirty_range (uint64_t *pml4, const void *start, const void *end,
+		bool clear) {
+	struct dirty_aux aux;
+
+	check_range (start, end);
+	tlb_batch_init (&aux.b, pml4, false);
+	aux.clear = clear;
+	aux.dirty = false;
+	range_walk (pml4, 0, (uint64_t) start, (uint64_t) end, dirty_pte,
+			&aux, &aux.b);
+	tlb_batch_finish (&aux.b);
+	return aux.dirty;
+}
+
+struct for_each_aux {
+	pte_for_each_func *func;
+	void *aux;
+};
+
+static bool
+for_each_pte (uint64_t *pte, uint64_t va, void *aux_) {
+	struct for_each_aux *aux = aux_;
+
+	if (!(*pte & PTE_P))
+		return true;
+	return aux->func (pte, (void *) va, aux->aux);
+}
+
+/* Applies FUNC to each present entry that maps part of [START,
+ * END) in PML4, like pml4_for_each(), and returns false as soon as
+ * FUNC does.  A large page is passed as its PDE, with the address
+ * of its first page. */
+bool
+pml4_for_each_range (uint64_t *pml4, const void *start, const void *end,
+		pte_for_each_func *func, void *aux) {
+	struct for_each_aux fa = { func, aux };
+
+	check_range (start, end);
+	return range_walk (pml4, 0, (uint64_t) start, (uint64_t) end,
+			for_each_pte, &fa, NULL);
+}
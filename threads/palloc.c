@@ -8,6 +8,7 @@
 #include <stdio.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/loader.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -24,24 +25,35 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+   palloc_print_stats() reports how much of each pool was actually
+   used, broken down by the mem_tag each page was charged to, as a
+   basis for choosing -ul. */
 
 /* A memory pool. */
 struct pool {
 	struct lock lock;               /* Mutual exclusion. */
 	struct bitmap *used_map;        /* Bitmap of free pages. */
+	uint8_t *tags;                  /* mem_tag of each page. */
 	uint8_t *base;                  /* Base of pool. */
+	size_t usable_cnt;              /* Pages backed by usable RAM. */
+	size_t used_cnt;                /* Pages allocated. */
+	size_t peak_cnt;                /* High-water mark of USED_CNT. */
 };
 
 /* Two pools: one for kernel data, one for user pages. */
 static struct pool kernel_pool, user_pool;
 
+/* Page usage by tag. */
+static struct mem_usage page_usage[MEM_TAG_CNT];
+
 /* Maximum number of pages to put in user pool. */
 size_t user_page_limit = SIZE_MAX;
 static void
 init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end);
 
 static bool page_from_pool (const struct pool *, void *page);
+static size_t scan_aligned (struct pool *, size_t page_cnt, size_t align);
 
 /* multiboot info */
 struct multiboot_info {
@@ -232,6 +244,11 @@ split:
 			}
 		}
 	}
+
+	kernel_pool.usable_cnt = bitmap_count (kernel_pool.used_map, 0,
+			bitmap_size (kernel_pool.used_map), false);
+	user_pool.usable_cnt = bitmap_count (user_pool.used_map, 0,
+			bitmap_size (user_pool.used_map), false);
 }
 
 /* Initializes the page allocator and get the memory size */
@@ -261,10 +278,37 @@ palloc_init (void) {
    FLAGS, in which case the kernel panics. */
 void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt) {
+	return palloc_get_aligned (flags, page_cnt, PGSIZE);
+}
+
+/* Like palloc_get_multiple(), but the first page's address is a
+   multiple of ALIGN, which must be a power of 2 and at least
+   PGSIZE.  Since the kernel maps physical memory at an aligned
+   base, the physical address is equally aligned, as a large
+   page requires. */
+void *
+palloc_get_aligned (enum palloc_flags flags, size_t page_cnt, size_t align) {
 	struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+	enum mem_tag tag = flags >> PAL_TAG_SHIFT;
+	enum intr_level old_level;
+
+	if (tag == MEM_MISC && (flags & PAL_USER))
+		tag = MEM_USER;
+	ASSERT (tag < MEM_TAG_CNT);
+	ASSERT (align >= PGSIZE && (align & (align - 1)) == 0);
 
 	lock_acquire (&pool->lock);
-	size_t page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
+	size_t page_idx = align == PGSIZE
+		? bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false)
+		: scan_aligned (pool, page_cnt, align);
+	if (page_idx != BITMAP_ERROR) {
+		memset (pool->tags + page_idx, tag, page_cnt);
+		old_level = intr_disable ();
+		pool->used_cnt += page_cnt;
+		if (pool->used_cnt > pool->peak_cnt)
+			pool->peak_cnt = pool->used_cnt;
+		intr_set_level (old_level);
+	}
 	lock_release (&pool->lock);
 	void *pages;
 
@@ -274,6 +318,7 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt) {
 		pages = NULL;
 
 	if (pages) {
+		mem_usage_charge (&page_usage[tag], PGSIZE * page_cnt);
 		if (flags & PAL_ZERO)
 			memset (pages, 0, PGSIZE * page_cnt);
 	} else {
@@ -301,6 +346,7 @@ void
 palloc_free_multiple (void *pages, size_t page_cnt) {
 	struct pool *pool;
 	size_t page_idx;
+	enum intr_level old_level;
 
 	ASSERT (pg_ofs (pages) == 0);
 	if (pages == NULL || page_cnt == 0)
@@ -319,6 +365,13 @@ palloc_free_multiple (void *pages, size_t page_cnt) {
 	memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 	ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
+	mem_usage_uncharge (&page_usage[pool->tags[page_idx]], PGSIZE * page_cnt);
+
+	/* This may run inside the scheduler with interrupts off, so
+	   don't take the pool lock for the counter. */
+	old_level = intr_disable ();
+	pool->used_cnt -= page_cnt;
+	intr_set_level (old_level);
 	bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
 }
 
@@ -328,6 +381,108 @@ palloc_free_page (void *page) {
 	palloc_free_multiple (page, 1);
 }
 
+/* Returns the number of free pages in the user pool if PAL_USER
+   is set in FLAGS, otherwise in the kernel pool. */
+size_t
+palloc_free_cnt (enum palloc_flags flags) {
+	struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+	return pool->usable_cnt - pool->used_cnt;
+}
+
+/* Returns the tag that PAGE, which must be the first page of an
+   allocation, was charged to. */
+enum mem_tag
+palloc_page_tag (const void *page) {
+	struct pool *pool;
+
+	if (page_from_pool (&kernel_pool, (void *) page))
+		pool = &kernel_pool;
+	else if (page_from_pool (&user_pool, (void *) page))
+		pool = &user_pool;
+	else
+		NOT_REACHED ();
+	return pool->tags[pg_no (page) - pg_no (pool->base)];
+}
+
+/* Prints page allocator statistics: occupancy of each pool and
+   pages by owner. */
+void
+palloc_print_stats (void) {
+	printf ("Palloc: kernel pool %zu of %zu pages, peak %zu; "
+			"user pool %zu of %zu pages, peak %zu\n",
+			kernel_pool.used_cnt, bitmap_size (kernel_pool.used_map),
+			kernel_pool.peak_cnt,
+			user_pool.used_cnt, bitmap_size (user_pool.used_map),
+			user_pool.peak_cnt);
+	for (enum mem_tag tag = 0; tag < MEM_TAG_CNT; tag++) {
+		const struct mem_usage *u = &page_usage[tag];
+		if (u->allocs == 0)
+			continue;
+		printf ("  %-12s %8zu kB live %8zu kB peak %8llu allocs %8llu frees\n",
+				mem_tag_name (tag), u->live / 1024, u->peak / 1024,
+				u->allocs, u->frees);
+	}
+}
+
+/* Returns a human-readable name for TAG. */
+const char *
+mem_tag_name (enum mem_tag tag) {
+	static const char *names[MEM_TAG_CNT] = {
+		[MEM_MISC] = "misc",
+		[MEM_ARENA] = "arena",
+		[MEM_THREAD] = "thread",
+		[MEM_PGTBL] = "page table",
+		[MEM_USER] = "user frame",
+		[MEM_SPT] = "spt",
+		[MEM_FRAME] = "frame",
+		[MEM_INODE] = "inode",
+		[MEM_SWAP] = "swap",
+		[MEM_SCRATCH] = "scratch",
+	};
+	ASSERT (tag < MEM_TAG_CNT);
+	return names[tag];
+}
+
+/* Records an allocation of BYTES in U.  Safe to call from any
+   context, including with interrupts off. */
+void
+mem_usage_charge (struct mem_usage *u, size_t bytes) {
+	enum intr_level old_level = intr_disable ();
+	u->live += bytes;
+	if (u->live > u->peak)
+		u->peak = u->live;
+	u->allocs++;
+	intr_set_level (old_level);
+}
+
+/* Records a release of BYTES in U. */
+void
+mem_usage_uncharge (struct mem_usage *u, size_t bytes) {
+	enum intr_level old_level = intr_disable ();
+	ASSERT (u->live >= bytes);
+	u->live -= bytes;
+	u->frees++;
+	intr_set_level (old_level);
+}
+
+/* Finds PAGE_CNT free pages in POOL starting at a multiple of
+   ALIGN, marks them used and returns the index of the first one,
+   or BITMAP_ERROR if there is no such run.  POOL's lock must be
+   held. */
+static size_t
+scan_aligned (struct pool *pool, size_t page_cnt, size_t align) {
+	size_t step = align / PGSIZE;
+	size_t idx = pg_no ((void *) ROUND_UP ((uint64_t) pool->base, align))
+		- pg_no (pool->base);
+
+	for (; idx + page_cnt <= bitmap_size (pool->used_map); idx += step)
+		if (bitmap_none (pool->used_map, idx, page_cnt)) {
+			bitmap_set_multiple (pool->used_map, idx, page_cnt, true);
+			return idx;
+		}
+	return BITMAP_ERROR;
+}
+
 /* Initializes pool P as starting at START and ending at END */
 static void
 init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end) {
@@ -336,15 +491,19 @@ init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end) {
      and subtract it from the pool's size. */
 	uint64_t pgcnt = (end - start) / PGSIZE;
 	size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (pgcnt), PGSIZE) * PGSIZE;
+	size_t tag_pages = DIV_ROUND_UP (pgcnt, PGSIZE) * PGSIZE;
 
 	lock_init(&p->lock);
 	p->used_map = bitmap_create_in_buf (pgcnt, *bm_base, bm_pages);
+	p->tags = (uint8_t *) *bm_base + bm_pages;
 	p->base = (void *) start;
+	p->usable_cnt = p->used_cnt = p->peak_cnt = 0;
 
 	// Mark all to unusable.
 	bitmap_set_all(p->used_map, true);
+	memset (p->tags, MEM_MISC, pgcnt);
 
-	*bm_base += bm_pages;
+	*bm_base += bm_pages + tag_pages;
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -0,0 +1,97 @@
+#include "threads/scratch.h"
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Per-thread scratch arena.
+
+   Buffers that live only for the duration of one operation, such
+   as the sector bounce buffers of the file system and the path
+   names copied in by system calls, come from a small arena owned
+   by the running thread instead of malloc() or palloc().  The
+   arena is a stack: scratch_alloc() bumps the top, and
+   scratch_release() pops everything allocated since the matching
+   scratch_mark().  Anything still allocated when a system call
+   returns to user mode is dropped by scratch_reset(), so system
+   call handlers need not release what they allocate.
+
+   The arena's pages are taken on first use and kept until the
+   thread dies, so the steady state makes no allocator calls at
+   all.  Scratch memory must not be used from interrupt handlers,
+   and a block must not outlive the operation that allocated it. */
+
+/* Blocks are aligned to this many bytes. */
+#define SCRATCH_ALIGN 16
+
+/* Returns a block of SIZE bytes from the running thread's arena,
+   or a null pointer if the arena is exhausted or cannot be
+   allocated. */
+void *
+scratch_alloc (size_t size) {
+	struct thread *t = thread_current ();
+	void *block;
+
+	ASSERT (!intr_context ());
+
+	if (t->scratch == NULL) {
+		t->scratch = palloc_get_multiple (PAL_TAG (MEM_SCRATCH),
+				SCRATCH_SIZE / PGSIZE);
+		if (t->scratch == NULL)
+			return NULL;
+	}
+
+	size = ROUND_UP (size, SCRATCH_ALIGN);
+	if (size > SCRATCH_SIZE - t->scratch_top)
+		return NULL;
+	block = t->scratch + t->scratch_top;
+	t->scratch_top += size;
+	return block;
+}
+
+/* Shrinks BLOCK, which must be the most recent allocation, to
+   SIZE bytes, returning the rest to the arena. */
+void
+scratch_trim (void *block, size_t size) {
+	struct thread *t = thread_current ();
+	size_t ofs = (uint8_t *) block - t->scratch;
+
+	ASSERT (ofs + ROUND_UP (size, SCRATCH_ALIGN) <= t->scratch_top);
+	t->scratch_top = ofs + ROUND_UP (size, SCRATCH_ALIGN);
+}
+
+/* Returns the current top of the running thread's arena, for
+   scratch_release(). */
+size_t
+scratch_mark (void) {
+	return thread_current ()->scratch_top;
+}
+
+/* Frees every block allocated since scratch_mark() returned
+   MARK. */
+void
+scratch_release (size_t mark) {
+	struct thread *t = thread_current ();
+
+	ASSERT (mark <= t->scratch_top);
+	t->scratch_top = mark;
+}
+
+/* Frees every block in the running thread's arena. */
+void
+scratch_reset (void) {
+	thread_current ()->scratch_top = 0;
+}
+
+/* Frees dying thread T's arena.  May be called with interrupts
+   off. */
+void
+scratch_destroy (struct thread *t) {
+	if (t->scratch != NULL) {
+		palloc_free_multiple (t->scratch, SCRATCH_SIZE / PGSIZE);
+		t->scratch = NULL;
+	}
+}
@@ -4,6 +4,7 @@
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
 #include "threads/palloc.h"
+#include "threads/scratch.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
 #include <debug.h>
@@ -176,7 +177,7 @@ tid_t thread_create(const char *name, int priority, thread_func *function,
   ASSERT(function != NULL);
 
   /* Allocate thread. */
-  t = palloc_get_page(PAL_ZERO);
+  t = palloc_get_page(PAL_ZERO | PAL_TAG(MEM_THREAD));
   if (t == NULL)
     return TID_ERROR;
 
@@ -536,6 +537,7 @@ static void do_schedule(int status) {
   while (!list_empty(&destruction_req)) {
     struct thread *victim =
         list_entry(list_pop_front(&destruction_req), struct thread, elem);
+    scratch_destroy(victim);
     palloc_free_page(victim);
   }
   thread_current()->status = status;
@@ -2,6 +2,7 @@
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "intrinsic.h"
 #include "threads/flags.h"
 #include "threads/init.h"
@@ -9,6 +10,7 @@
 #include "threads/mmu.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/scratch.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "userprog/gdt.h"
@@ -65,10 +67,7 @@ static struct child_info *find_child_info(struct thread *parent, tid_t tid) {
 
 /* General process initializer for initd and other process. */
 static void process_init(void) {
-  struct thread *current = thread_current();
-#ifdef VM
-  list_init(&current->mmap_list);
-#endif
+  struct thread *current UNUSED = thread_current();
 }
 
 /* Starts the first userland program, called "initd", loaded from FILE_NAME.
@@ -139,6 +138,7 @@ static void initd(void *aux) {
   free(args);
 #ifdef VM
   supplemental_page_table_init(&thread_current()->spt);
+  thread_current()->rss_limit = vm_rss_limit;
 #endif
 
   process_init();
@@ -200,22 +200,18 @@ tid_t process_fork(const char *name, struct intr_frame *if_ UNUSED) {
 
 #ifndef VM
 /* Duplicate the parent's address space by passing this function to the
- * pml4_for_each. This is only for the project 2. */
-static bool duplicate_pte(uint64_t *pte, void *va, void *aux) {
+ * pml4_for_each_range. This is only for the project 2. */
+static bool duplicate_pte(uint64_t *pte, void *va, void *aux UNUSED) {
   struct thread *current = thread_current();
-  struct thread *parent = (struct thread *)aux;
   void *parent_page;
   void *newpage;
   bool writable;
 
-  /* 1. TODO: If the parent_page is kernel page, then return immediately. */
-  if (is_kernel_vaddr(va))
-    return true;
+  /* 1. Only user pages are visited: see __do_fork(). */
+  ASSERT(is_user_vaddr(va));
 
-  /* 2. Resolve VA from the parent's page map level 4. */
-  parent_page = pml4_get_page(parent->pml4, va);
-  if (parent_page == NULL)
-    return true;
+  /* 2. The frame comes straight from PTE, with no second walk. */
+  parent_page = ptov(PTE_ADDR(*pte));
 
   /* 3. TODO: Allocate new PAL_USER page for the child and set result to
    *    TODO: NEWPAGE. */
@@ -265,10 +261,12 @@ static void __do_fork(void *aux) {
   process_activate(current);
 #ifdef VM
   supplemental_page_table_init(&current->spt);
+  current->rss_limit = parent->rss_limit;
   if (!supplemental_page_table_copy(&current->spt, &parent->spt))
     goto error;
 #else
-  if (!pml4_for_each(parent->pml4, duplicate_pte, parent))
+  if (!pml4_for_each_range(parent->pml4, NULL, (void *)KERN_BASE,
+                           duplicate_pte, parent))
     goto error;
 #endif
 
@@ -376,7 +374,9 @@ int process_exec(void *f_name) {
   if (!success)
     return -1;
 
-  /* Start switched process. */
+  /* Start switched process.  This is the exit of the exec system
+   * call, so drop its scratch buffers. */
+  scratch_reset();
   do_iret(&_if);
   NOT_REACHED();
 }
@@ -432,8 +432,12 @@ void process_exit(void) {
   }
 
   /* Only print exit message for user processes */
-  if (curr->pml4 != NULL)
+  if (curr->pml4 != NULL) {
     printf("%s: exit(%d)\n", curr->name, curr->exit_status);
+#ifdef VM
+    vm_print_faults();
+#endif
+  }
 
   if (curr->child_info != NULL) {
     if (curr->child_info->parent_alive) {
@@ -454,7 +458,12 @@ void process_exit(void) {
       free(child);
   }
   lock_release(&curr->children_lock);
+  bool is_user = curr->pml4 != NULL;
   process_cleanup();
+
+  /* With -memleak, anything this process still owns is a leak. */
+  if (is_user)
+    malloc_leak_report(curr->tid);
 }
 
 /* Free the current process's resources. */
@@ -562,6 +571,7 @@ static bool load(const char *file_name, struct intr_frame *if_) {
   struct file *file = NULL;
   off_t file_ofs;
   bool success = false;
+  uint8_t *image_end = NULL;
   int i;
 
   /* Allocate and activate page directory. */
@@ -570,14 +580,25 @@ static bool load(const char *file_name, struct intr_frame *if_) {
     goto done;
   process_activate(thread_current());
 
-  /* Open executable file. */
+  /* Open executable file, and deny writes to it at once: its text
+   * is shared through the page cache, so it must not change under
+   * any process running it, nor may it be mapped writable. */
   lock_acquire(&filesys_lock);
   file = filesys_open(file_name);
+  bool mapped_writable = false;
+  if (file != NULL) {
+    file_deny_write(file);
+    mapped_writable = inode_is_mapped_writable(file_get_inode(file));
+  }
   lock_release(&filesys_lock);
   if (file == NULL) {
     printf("load: %s: open failed\n", file_name);
     goto done;
   }
+  if (mapped_writable) {
+    printf("load: %s: mapped writable\n", file_name);
+    goto done;
+  }
 
   /* Read and verify executable header. */
   lock_acquire(&filesys_lock);
@@ -641,12 +662,19 @@ static bool load(const char *file_name, struct intr_frame *if_) {
         if (!load_segment(file, file_page, (void *)mem_page, read_bytes,
                           zero_bytes, writable))
           goto done;
+        if ((uint8_t *)mem_page + read_bytes + zero_bytes > image_end)
+          image_end = (uint8_t *)mem_page + read_bytes + zero_bytes;
       } else
         goto done;
       break;
     }
   }
 
+#ifdef VM
+  /* The heap starts out empty, just past the image. */
+  t->spt.heap_start = t->spt.brk = image_end;
+#endif
+
   /* Set up stack. */
   if (!setup_stack(if_))
     goto done;
@@ -659,9 +687,6 @@ static bool load(const char *file_name, struct intr_frame *if_) {
 
 	success = true;
 
-	lock_acquire(&filesys_lock);
-	file_deny_write(file);
-	lock_release(&filesys_lock);
 	t->exec_file = file;
 	file = NULL;
 
@@ -824,20 +849,28 @@ static bool lazy_load_segment(struct page *page, void *aux) {
   size_t read_bytes = args->read_bytes;
   size_t zero_bytes = args->zero_bytes;
   struct file *file = args->file;
+  const void *data = args->data;
+  uint8_t *kva = page_kva(page);
 
   free(args);
 
-  lock_acquire(&filesys_lock);
-  int n = file_read_at(file, page->frame->kva, read_bytes, ofs);
-  lock_release(&filesys_lock);
-  if (n != (int)read_bytes)
-    return false;
-  memset(page->frame->kva + read_bytes, 0, zero_bytes);
+  if (data != NULL) {
+    /* Already read by fault-around. */
+    memcpy(kva, data, read_bytes);
+  } else {
+    lock_acquire(&filesys_lock);
+    int n = file_read_at(file, kva, read_bytes, ofs);
+    lock_release(&filesys_lock);
+    if (n != (int)read_bytes)
+      return false;
+  }
+  memset(kva + read_bytes, 0, zero_bytes);
   return true;
 }
 
-/* Loads a segment starting at offset OFS in FILE at address
- * UPAGE.  In total, READ_BYTES + ZERO_BYTES bytes of virtual
+/* Maps a segment starting at offset OFS in FILE at address
+ * UPAGE as regions whose pages are loaded as they are first
+ * touched.  In total, READ_BYTES + ZERO_BYTES bytes of virtual
  * memory are initialized, as follows:
  *
  * - READ_BYTES bytes at UPAGE must be read from FILE
@@ -846,7 +879,10 @@ static bool lazy_load_segment(struct page *page, void *aux) {
  * - ZERO_BYTES bytes at UPAGE + READ_BYTES must be zeroed.
  *
  * The pages initialized by this function must be writable by the
- * user process if WRITABLE is true, read-only otherwise.
+ * user process if WRITABLE is true, read-only otherwise.  The
+ * whole pages of file data of a read-only segment are shared
+ * with other processes running the same executable; the rest get
+ * private pages.
  *
  * Return true if successful, false if a memory allocation error
  * or disk read error occurs. */
@@ -857,31 +893,50 @@ static bool load_segment(struct file *file, off_t ofs, uint8_t *upage,
   ASSERT(pg_ofs(upage) == 0);
   ASSERT(ofs % PGSIZE == 0);
 
-  while (read_bytes > 0 || zero_bytes > 0) {
-    /* Do calculate how to fill this page.
-     * We will read PAGE_READ_BYTES bytes from FILE
-     * and zero the final PAGE_ZERO_BYTES bytes. */
-    size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
-    size_t page_zero_bytes = PGSIZE - page_read_bytes;
+  size_t shared_cnt = writable ? 0 : read_bytes / PGSIZE;
+  size_t shared_bytes = shared_cnt * PGSIZE;
 
-    struct segment_aux *aux = malloc(sizeof *aux);
-    if (aux == NULL)
+  /* Each region holds its own reference, so that it outlives
+   * exec_file in a forked child. */
+  if (shared_cnt > 0) {
+    lock_acquire(&filesys_lock);
+    struct file *text = file_reopen(file);
+    lock_release(&filesys_lock);
+    if (text == NULL)
       return false;
-    aux->file = file;
-    aux->ofs = ofs;
-    aux->read_bytes = page_read_bytes;
-    aux->zero_bytes = page_zero_bytes;
-    if (!vm_alloc_page_with_initializer(VM_ANON, upage, writable,
-                                        lazy_load_segment, aux)) {
-      free(aux);
+    if (!file_map_text(upage, shared_cnt, text, ofs)) {
+      lock_acquire(&filesys_lock);
+      file_close(text);
+      lock_release(&filesys_lock);
       return false;
     }
+    upage += shared_bytes;
+    ofs += shared_bytes;
+    read_bytes -= shared_bytes;
+    if (read_bytes + zero_bytes == 0)
+      return true;
+  }
 
-    /* Advance. */
-    read_bytes -= page_read_bytes;
-    zero_bytes -= page_zero_bytes;
-    upage += PGSIZE;
-    ofs += page_read_bytes;
+  struct vma vma = {
+      .start = upage,
+      .end = upage + read_bytes + zero_bytes,
+      .type = VM_ANON,
+      .writable = writable,
+      .init = lazy_load_segment,
+      .ofs = ofs,
+      .read_bytes = read_bytes,
+  };
+
+  lock_acquire(&filesys_lock);
+  vma.file = file_reopen(file);
+  lock_release(&filesys_lock);
+  if (vma.file == NULL)
+    return false;
+  if (vma_add(&thread_current()->spt, &vma) == NULL) {
+    lock_acquire(&filesys_lock);
+    file_close(vma.file);
+    lock_release(&filesys_lock);
+    return false;
   }
   return true;
 }
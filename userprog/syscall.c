@@ -9,6 +9,7 @@
 #include "threads/loader.h"
 #include "threads/mmu.h"
 #include "threads/palloc.h"
+#include "threads/scratch.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
@@ -21,10 +22,12 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include <syscall-nr.h>
 
 void syscall_entry(void);
 void syscall_handler(struct intr_frame *);
+static void syscall_dispatch(struct intr_frame *);
 
 struct lock filesys_lock;
 
@@ -72,69 +75,127 @@ static void validate_user_buffer(const void *buffer, size_t size) {
   }
 }
 
+/* pml4_for_each_range() helper for validate_user_writable_buffer():
+ * checks that the page at VA is writable by the user and follows
+ * the last one seen, whose end is in *AUX.  When it fails, or the
+ * walk ends short of the range, *AUX is the first page that is not
+ * mapped writable. */
+static bool check_writable_pte(uint64_t *pte, void *va, void *aux) {
+  uintptr_t *next = aux;
+
+  if ((uintptr_t)va > *next || !is_user_pte(pte) || !is_writable(pte))
+    return false;
+  *next = (uintptr_t)va + (is_large_pte(pte) ? LARGE_PGSIZE : PGSIZE);
+  return true;
+}
+
+/* Makes user page PAGE present and writable, as a store to it
+ * would.  Returns false if it cannot be. */
+static bool fault_in_writable(uint8_t *page) {
+#ifdef VM
+  if (pml4_get_page(thread_current()->pml4, page) == NULL &&
+      !vm_claim_page(page))
+    return false;
+  /* A shared read-only frame gets a private copy first. */
+  return vm_make_writable(page);
+#else
+  (void)page;
+  return false;
+#endif
+}
+
 static void validate_user_writable_buffer(void *buffer, size_t size) {
   if (size == 0)
     return;
 
-  validate_user_buffer(buffer, size);
-
-  struct thread *curr = thread_current();
   uintptr_t start = (uintptr_t)buffer;
   uintptr_t end = start + size - 1;
+  if (buffer == NULL || end < start || !is_user_vaddr((void *)end))
+    sys_exit(-1);
 
-  for (uintptr_t page = (uintptr_t)pg_round_down((const void *)start);
-       page <= (uintptr_t)pg_round_down((const void *)end); page += PGSIZE) {
-    /* Make sure the page is present (lazy/swap-in). */
-    validate_user_address((const void *)page);
-    uint64_t *pte = pml4e_walk(curr->pml4, page, 0);
-    if (pte == NULL || ((*pte & PTE_P) == 0) || !is_user_pte(pte) ||
-        !is_writable(pte))
+  struct thread *curr = thread_current();
+  if (curr->pml4 == NULL)
+    sys_exit(-1);
+
+  /* One walk over the range, which stops only at a page that is
+   * not present or not writable: that page is faulted in and the
+   * walk picks up again from it.  A page still not writable after
+   * that cannot be written. */
+  uint8_t *limit = (uint8_t *)pg_round_down((void *)end) + PGSIZE;
+  uintptr_t next = (uintptr_t)pg_round_down(buffer);
+  uint8_t *retried = NULL;
+  for (;;) {
+    if (pml4_for_each_range(curr->pml4, (void *)next, limit,
+                            check_writable_pte, &next) &&
+        next >= (uintptr_t)limit)
+      return;
+    if ((uint8_t *)next == retried || !fault_in_writable((uint8_t *)next))
       sys_exit(-1);
+    retried = (uint8_t *)next;
   }
 }
 
+/* Copies the user string USTR into the running thread's scratch
+ * arena and returns it.  The copy lives until the system call
+ * returns.  Kills the process if USTR is not a valid user string
+ * of less than a page. */
 static char *copy_in_string(const char *ustr) {
   if (ustr == NULL)
     sys_exit(-1);
 
   struct thread *curr = thread_current();
-  char *kstr = palloc_get_page(0);
+  char *kstr = scratch_alloc(PGSIZE);
   if (kstr == NULL)
     sys_exit(-1);
 
   for (size_t i = 0; i < PGSIZE; i++) {
     const void *uaddr = (const void *)(ustr + i);
-    if (uaddr == NULL || !is_user_vaddr(uaddr) || curr->pml4 == NULL) {
-      palloc_free_page(kstr);
+    if (uaddr == NULL || !is_user_vaddr(uaddr) || curr->pml4 == NULL)
       sys_exit(-1);
-    }
     const char *kaddr = pml4_get_page(curr->pml4, uaddr);
     if (kaddr == NULL) {
 #ifdef VM
-      if (!vm_claim_page(pg_round_down(uaddr))) {
-        palloc_free_page(kstr);
+      if (!vm_claim_page(pg_round_down(uaddr)))
         sys_exit(-1);
-      }
       kaddr = pml4_get_page(curr->pml4, uaddr);
-      if (kaddr == NULL) {
-        palloc_free_page(kstr);
+      if (kaddr == NULL)
         sys_exit(-1);
-      }
 #else
-      palloc_free_page(kstr);
       sys_exit(-1);
 #endif
     }
 
     kstr[i] = *kaddr;
-    if (kstr[i] == '\0')
+    if (kstr[i] == '\0') {
+      scratch_trim(kstr, i + 1);
       return kstr;
+    }
   }
 
-  palloc_free_page(kstr);
   sys_exit(-1);
 }
 
+/* Returns the kernel address of user address UADDR, which must
+ * have been validated, and keeps its page resident until
+ * put_user_page() so that it cannot be evicted while file I/O on
+ * it blocks.  WRITE says whether the kernel will store to it. */
+static void *get_user_page(const void *uaddr, bool write) {
+#ifdef VM
+  return vm_pin_page(uaddr, write);
+#else
+  (void)write;
+  return pml4_get_page(thread_current()->pml4, uaddr);
+#endif
+}
+
+static void put_user_page(const void *uaddr) {
+#ifdef VM
+  vm_unpin_page(uaddr);
+#else
+  (void)uaddr;
+#endif
+}
+
 static struct file *get_file(int fd) {
   struct thread *curr = thread_current();
   if (fd < 2 || fd >= 128)
@@ -202,6 +263,14 @@ void syscall_init(void) {
 
 /* The main system call interface */
 void syscall_handler(struct intr_frame *f) {
+  syscall_dispatch(f);
+
+  /* Nothing the call left in the scratch arena is live now. */
+  scratch_reset();
+}
+
+/* Carries out the system call described by F. */
+static void syscall_dispatch(struct intr_frame *f) {
   int syscall_num = f->R.rax;
 
   switch (syscall_num) {
@@ -214,13 +283,17 @@ void syscall_handler(struct intr_frame *f) {
   case SYS_FORK: {
     char *thread_name = copy_in_string((const char *)f->R.rdi);
     tid_t tid = process_fork(thread_name, f);
-    palloc_free_page(thread_name);
     f->R.rax = tid;
     return;
   }
 
   case SYS_EXEC: {
-    char *cmd_line = copy_in_string((const char *)f->R.rdi);
+    /* process_exec() takes ownership of a page. */
+    const char *arg = copy_in_string((const char *)f->R.rdi);
+    char *cmd_line = palloc_get_page(0);
+    if (cmd_line == NULL)
+      sys_exit(-1);
+    strlcpy(cmd_line, arg, PGSIZE);
     int result = process_exec(cmd_line);
     f->R.rax = result;
     return;
@@ -240,7 +313,6 @@ void syscall_handler(struct intr_frame *f) {
     bool ok = filesys_create(file, initial_size);
     lock_release(&filesys_lock);
 
-    palloc_free_page(file);
     f->R.rax = ok;
     return;
   }
@@ -252,7 +324,6 @@ void syscall_handler(struct intr_frame *f) {
     bool ok = filesys_remove(file);
     lock_release(&filesys_lock);
 
-    palloc_free_page(file);
     f->R.rax = ok;
     return;
   }
@@ -264,7 +335,6 @@ void syscall_handler(struct intr_frame *f) {
     struct file *file = filesys_open(file_name);
     lock_release(&filesys_lock);
 
-    palloc_free_page(file_name);
     if (file == NULL) {
       f->R.rax = -1;
       return;
@@ -305,9 +375,13 @@ void syscall_handler(struct intr_frame *f) {
 
     if (fd == 0) {
       for (unsigned i = 0; i < size; i++) {
-        uint8_t *dst = pml4_get_page(thread_current()->pml4,
-                                     (const void *)((uint8_t *)buffer + i));
-        *dst = input_getc();
+        uint8_t *udst = (uint8_t *)buffer + i;
+        uint8_t c = input_getc();
+        uint8_t *dst = get_user_page(udst, true);
+        if (dst == NULL)
+          sys_exit(-1);
+        *dst = c;
+        put_user_page(udst);
       }
       f->R.rax = (int)size;
       return;
@@ -328,13 +402,14 @@ void syscall_handler(struct intr_frame *f) {
     while (size > 0) {
       size_t page_left = PGSIZE - pg_ofs(buffer);
       size_t chunk = size < page_left ? size : page_left;
-      void *kaddr = pml4_get_page(thread_current()->pml4, buffer);
+      void *kaddr = get_user_page(buffer, true);
       if (kaddr == NULL) {
         lock_release(&filesys_lock);
         sys_exit(-1);
       }
 
       off_t n = file_read(file, kaddr, (off_t)chunk);
+      put_user_page(buffer);
       if (n <= 0)
         break;
       bytes_read += n;
@@ -376,13 +451,14 @@ void syscall_handler(struct intr_frame *f) {
     while (size > 0) {
       size_t page_left = PGSIZE - pg_ofs(buffer);
       size_t chunk = size < page_left ? size : page_left;
-      const void *kaddr = pml4_get_page(thread_current()->pml4, buffer);
+      const void *kaddr = get_user_page(buffer, false);
       if (kaddr == NULL) {
         lock_release(&filesys_lock);
         sys_exit(-1);
       }
 
       off_t n = file_write(file, kaddr, (off_t)chunk);
+      put_user_page(buffer);
       if (n <= 0)
         break;
       bytes_written += n;
@@ -440,8 +516,8 @@ void syscall_handler(struct intr_frame *f) {
     int fd = (int)f->R.r10;
     off_t offset = (off_t)f->R.r8;
 
-    struct file *file = get_file(fd);
-    if (file == NULL) {
+    struct file *file = NULL;
+    if (!(writable & MAP_ANONYMOUS) && (file = get_file(fd)) == NULL) {
       f->R.rax = (uint64_t)NULL;
       return;
     }
@@ -455,6 +531,30 @@ void syscall_handler(struct intr_frame *f) {
     do_munmap(addr);
     return;
   }
+
+  case SYS_MADVISE: {
+    void *addr = (void *)f->R.rdi;
+    size_t length = (size_t)f->R.rsi;
+    int advice = (int)f->R.rdx;
+    f->R.rax = vm_madvise(addr, length, advice) ? 0 : -1;
+    return;
+  }
+  case SYS_MSYNC: {
+    void *addr = (void *)f->R.rdi;
+    size_t length = (size_t)f->R.rsi;
+    int flags = (int)f->R.rdx;
+    f->R.rax = vm_msync(addr, length, flags) ? 0 : -1;
+    return;
+  }
+  case SYS_SET_RSS_LIMIT:
+    f->R.rax = vm_set_rss_limit((size_t)f->R.rdi);
+    return;
+  case SYS_BRK:
+    f->R.rax = vm_brk((void *)f->R.rdi) ? 0 : -1;
+    return;
+  case SYS_SBRK:
+    f->R.rax = (uint64_t)vm_sbrk((intptr_t)f->R.rdi);
+    return;
 #endif
 
   default:
@@ -3,19 +3,106 @@
 #include "vm/vm.h"
 #include "devices/disk.h"
 #include "lib/kernel/bitmap.h"
+#include "lib/kernel/hash.h"
+#include "threads/malloc.h"
 #include "threads/synch.h"
 #include "threads/mmu.h"
 #include "threads/vaddr.h"
+#include <stdio.h>
 #include <string.h>
+#include <syscall-nr.h>
 
 /* DO NOT MODIFY BELOW LINE */
-static struct disk *swap_disk;
 static struct bitmap *swap_table;
 static struct lock swap_lock;
 static bool anon_swap_in (struct page *page, void *kva);
 static bool anon_swap_out (struct page *page);
 static void anon_destroy (struct page *page);
 
+/* Where swapped pages went, and where they came back from. */
+static unsigned long long out_zswap_cnt, out_disk_cnt;
+static unsigned long long in_zswap_cnt, in_disk_cnt;
+
+/* Swap slots are handed out in clusters of SWAP_CLUSTER
+ * consecutive slots.  A cluster belongs to one aligned window of
+ * SWAP_CLUSTER virtual pages in one process, and each page of the
+ * window always goes to the same slot in it, so pages that are
+ * neighbours in memory are neighbours on disk.  When no cluster is
+ * free, or a page's own slot is taken, the page goes to any free
+ * slot instead.  Everything here is protected by SWAP_LOCK. */
+#define SWAP_CLUSTER 8
+
+struct swap_cluster {
+	struct hash_elem elem;     /* In CLUSTER_MAP while owned. */
+	struct thread *owner;      /* Owning process, or NULL. */
+	uintptr_t window;          /* Virtual page number / SWAP_CLUSTER. */
+	size_t used;               /* Slots in use. */
+};
+
+/* Swap devices.  Slots are numbered across all of them, each
+ * device holding a run of whole clusters.  A new cluster comes from
+ * the device of highest priority that has one free; devices of
+ * equal priority take turns, so that page-outs are striped across
+ * them and go to each disk channel at once.  Writes are done
+ * without SWAP_LOCK; SWAP_WRITING marks the slots still in flight
+ * so that read-ahead skips them.  The devices are named with
+ * -swap, and are just hd1:1 by default. */
+#define SWAP_DEV_MAX 4
+
+struct swap_dev {
+	struct disk *disk;
+	int chan, dev;             /* The disk is hdCHAN:DEV. */
+	int prio;                  /* Devices of higher priority go first. */
+	size_t first;              /* First cluster on the device. */
+	size_t cnt;                /* Number of clusters on it. */
+	size_t used;               /* Slots in use. */
+	unsigned long long write_cnt, read_cnt;   /* Pages. */
+};
+
+static struct swap_dev swap_devs[SWAP_DEV_MAX];  /* By priority. */
+static size_t swap_dev_cnt;
+static size_t stripe_next;            /* Rotates among equal devices. */
+static struct bitmap *swap_writing;   /* Slots being written. */
+
+static struct swap_cluster *clusters;
+static struct bitmap *cluster_used;   /* Clusters with any slot in use. */
+static struct thread **slot_owners;   /* Process each slot in use is for. */
+static struct hash cluster_map;       /* Owned clusters by owner, window. */
+
+/* Swap cache.  A disk swap-in reads the cluster's other slots that
+ * are in use by the same process along with the one it needs, in
+ * one sequential pass, and keeps them here for their pages' own
+ * faults.  Slots of other processes, which end up in a cluster when
+ * pages are scattered, are skipped, so that one process's fault does
+ * no I/O for another's pages.  Entries with SLOT == BITMAP_ERROR
+ * are empty; LRU has the most recently filled entry at the front. */
+#define SWAP_CACHE_CNT 16
+
+struct swap_cache_entry {
+	struct list_elem elem;
+	size_t slot;
+	void *kva;                 /* Allocated on first use. */
+};
+
+static struct swap_cache_entry swap_cache[SWAP_CACHE_CNT];
+static struct list swap_cache_lru;
+
+static unsigned long long clustered_cnt, scattered_cnt;
+static unsigned long long readahead_cnt, cache_hit_cnt;
+
+static size_t cluster_alloc (void);
+static size_t slot_alloc (struct page *page);
+static void slot_free (size_t slot);
+static struct swap_dev *slot_dev (size_t slot);
+static void slot_read (size_t slot, void *kva);
+static void slot_write (size_t slot, const void *kva);
+static void read_cluster (size_t slot, void *kva);
+static struct swap_cache_entry *cache_find (size_t slot);
+static void cache_drop (struct swap_cache_entry *e);
+static uint64_t cluster_hash (const struct hash_elem *e, void *aux);
+static bool cluster_less (const struct hash_elem *a,
+		const struct hash_elem *b, void *aux);
+
 /* DO NOT MODIFY this struct */
 static const struct page_operations anon_ops = {
 	.swap_in = anon_swap_in,
@@ -24,22 +111,89 @@ static const struct page_operations anon_ops = {
 	.type = VM_ANON,
 };
 
+/* Adds hdCHAN:DEV as a swap device of priority PRIO, for -swap.
+ * Either channel may be used, so that devices of equal priority on
+ * both are written at once.  hd0:1 holds the file system and hd1:0
+ * the scratch disk, and are refused.  hd0:0 is only read by the
+ * loader, so it is free once the kernel runs.  The disk is opened by
+ * vm_anon_init().  Returns false if the disk does not exist or is
+ * refused, is already listed, or there are too many devices. */
+bool
+anon_swap_add (int chan, int dev, int prio) {
+	struct swap_dev *d;
+
+	if (chan < 0 || chan > 1 || dev < 0 || dev > 1)
+		return false;
+	if ((chan == 0 && dev == 1) || (chan == 1 && dev == 0))
+		return false;
+	if (swap_dev_cnt >= SWAP_DEV_MAX)
+		return false;
+	for (size_t i = 0; i < swap_dev_cnt; i++)
+		if (swap_devs[i].chan == chan && swap_devs[i].dev == dev)
+			return false;
+
+	/* Keep the table sorted by priority; equal ones in order given. */
+	for (d = &swap_devs[swap_dev_cnt]; d > swap_devs && d[-1].prio < prio; d--)
+		d[0] = d[-1];
+	d->chan = chan;
+	d->dev = dev;
+	d->prio = prio;
+	swap_dev_cnt++;
+	return true;
+}
+
 /* Initialize the data for anonymous pages */
 void
 vm_anon_init (void) {
-	/* Swap disk is attached as hd1:1 (qemu drive index 3). */
-	swap_disk = disk_get (1, 1);
-	if (swap_disk == NULL)
-		PANIC ("swap disk not present (hd1:1)");
+	size_t sectors_per_page = PGSIZE / DISK_SECTOR_SIZE;
+	size_t cluster_cnt = 0;
+
+	/* The default swap disk is attached as hd1:1 (qemu drive index 3). */
+	if (swap_dev_cnt == 0)
+		anon_swap_add (1, 1, 0);
+	for (size_t i = 0; i < swap_dev_cnt; i++) {
+		struct swap_dev *d = &swap_devs[i];
+
+		d->disk = disk_get (d->chan, d->dev);
+		if (d->disk == NULL)
+			PANIC ("swap disk not present (hd%d:%d)", d->chan, d->dev);
+		d->first = cluster_cnt;
+		d->cnt = disk_size (d->disk) / sectors_per_page / SWAP_CLUSTER;
+		cluster_cnt += d->cnt;
+	}
 
 	lock_init (&swap_lock);
 
-	size_t sectors_per_page = PGSIZE / DISK_SECTOR_SIZE;
-	size_t slot_cnt = disk_size (swap_disk) / sectors_per_page;
-	swap_table = bitmap_create (slot_cnt);
-	if (swap_table == NULL)
+	size_t slot_cnt = cluster_cnt * SWAP_CLUSTER;
+	size_t bm_size = bitmap_buf_size (slot_cnt);
+	void *bm_buf = malloc_tagged (bm_size, MEM_SWAP);
+	void *wr_buf = malloc_tagged (bm_size, MEM_SWAP);
+	if (bm_buf == NULL || wr_buf == NULL)
 		PANIC ("vm_anon_init: swap_table allocation failed");
+	swap_table = bitmap_create_in_buf (slot_cnt, bm_buf, bm_size);
 	bitmap_set_all (swap_table, false);
+	swap_writing = bitmap_create_in_buf (slot_cnt, wr_buf, bm_size);
+	bitmap_set_all (swap_writing, false);
+
+	bm_size = bitmap_buf_size (cluster_cnt);
+	bm_buf = malloc_tagged (bm_size, MEM_SWAP);
+	clusters = calloc_tagged (cluster_cnt, sizeof *clusters, MEM_SWAP);
+	slot_owners = calloc_tagged (slot_cnt, sizeof *slot_owners, MEM_SWAP);
+	if (bm_buf == NULL || (clusters == NULL && cluster_cnt > 0)
+		|| (slot_owners == NULL && slot_cnt > 0))
+		PANIC ("vm_anon_init: swap cluster allocation failed");
+	cluster_used = bitmap_create_in_buf (cluster_cnt, bm_buf, bm_size);
+	bitmap_set_all (cluster_used, false);
+	hash_init (&cluster_map, cluster_hash, cluster_less, NULL);
+
+	list_init (&swap_cache_lru);
+	for (size_t i = 0; i < SWAP_CACHE_CNT; i++) {
+		swap_cache[i].slot = BITMAP_ERROR;
+		swap_cache[i].kva = NULL;
+		list_push_back (&swap_cache_lru, &swap_cache[i].elem);
+	}
+
+	zswap_init ();
 }
 
 /* Initialize the file mapping */
@@ -50,6 +204,7 @@ anon_initializer (struct page *page, enum vm_type type, void *kva) {
 
 	struct anon_page *anon_page = &page->anon;
 	anon_page->slot = BITMAP_ERROR;
+	anon_page->zswap.zpage = NULL;
 	memset (kva, 0, PGSIZE);
 	(void) anon_page;
 	(void) type;
@@ -57,54 +212,103 @@ anon_initializer (struct page *page, enum vm_type type, void *kva) {
 	return true;
 }
 
-/* Swap in the page by read contents from the swap disk. */
+/* Swap in the page by decompressing it from zswap or reading
+ * contents from the swap disk. */
 static bool
 anon_swap_in (struct page *page, void *kva) {
 	struct anon_page *anon_page = &page->anon;
+	if (anon_page->zswap.zpage != NULL) {
+		bool ok = zswap_load (&anon_page->zswap, kva);
+		zswap_free (&anon_page->zswap);
+		in_zswap_cnt++;
+		return ok;
+	}
 	if (anon_page->slot == BITMAP_ERROR)
 		return false;
 
-	size_t sectors_per_page = PGSIZE / DISK_SECTOR_SIZE;
-	disk_sector_t base = (disk_sector_t) (anon_page->slot * sectors_per_page);
+	/* Skip read-around in regions advised MADV_RANDOM. */
+	struct vma *vma = page->owner == thread_current ()
+		? vma_find (&page->owner->spt, page->va) : NULL;
+	bool around = vma == NULL || vma->advice != MADV_RANDOM;
 
 	lock_acquire (&swap_lock);
-	for (size_t i = 0; i < sectors_per_page; i++)
-		disk_read (swap_disk, base + (disk_sector_t) i,
-			(uint8_t *) kva + i * DISK_SECTOR_SIZE);
-	bitmap_reset (swap_table, anon_page->slot);
+	struct swap_cache_entry *e = cache_find (anon_page->slot);
+	if (e != NULL) {
+		memcpy (kva, e->kva, PGSIZE);
+		cache_hit_cnt++;
+	} else if (around)
+		read_cluster (anon_page->slot, kva);
+	else
+		slot_read (anon_page->slot, kva);
+	slot_free (anon_page->slot);
 	lock_release (&swap_lock);
 
 	anon_page->slot = BITMAP_ERROR;
+	in_disk_cnt++;
 	return true;
 }
 
-/* Swap out the page by writing contents to the swap disk. */
+/* Swap out the page by compressing it into zswap or, if it does
+ * not fit there, writing contents to the swap disk.  The page is
+ * unmapped first so that its owner cannot modify it while the
+ * write is in flight; a fault on it waits for the frame to be
+ * unpinned. */
 static bool
 anon_swap_out (struct page *page) {
 	struct anon_page *anon_page = &page->anon;
 	if (page->frame == NULL)
 		return false;
 
+	if (page->owner != NULL)
+		pml4_clear_page (page->owner->pml4, page->va);
+
+	if (zswap_store (page->frame->kva, &anon_page->zswap)) {
+		out_zswap_cnt++;
+		vm_frame_detach (page);
+		return true;
+	}
+
 	lock_acquire (&swap_lock);
-	size_t slot = bitmap_scan_and_flip (swap_table, 0, 1, false);
+	size_t slot = slot_alloc (page);
 	if (slot == BITMAP_ERROR)
-		PANIC ("swap disk is full");
+		PANIC ("swap is full: all %zu slots on %zu devices in use",
+				bitmap_size (swap_table), swap_dev_cnt);
+	bitmap_mark (swap_writing, slot);
+	lock_release (&swap_lock);
 
-	size_t sectors_per_page = PGSIZE / DISK_SECTOR_SIZE;
-	disk_sector_t base = (disk_sector_t) (slot * sectors_per_page);
-	for (size_t i = 0; i < sectors_per_page; i++)
-		disk_write (swap_disk, base + (disk_sector_t) i,
-			(uint8_t *) page->frame->kva + i * DISK_SECTOR_SIZE);
+	/* Nothing else can use SLOT until PAGE records it. */
+	slot_write (slot, page->frame->kva);
+
+	lock_acquire (&swap_lock);
+	bitmap_reset (swap_writing, slot);
+	slot_dev (slot)->write_cnt++;
 	lock_release (&swap_lock);
 
 	anon_page->slot = slot;
+	out_disk_cnt++;
+	vm_frame_detach (page);
 
-	/* Unmap and detach from frame (frame is reused by eviction). */
-	if (page->owner != NULL)
-		pml4_clear_page (page->owner->pml4, page->va);
-	page->frame->page = NULL;
-	page->frame = NULL;
+	return true;
+}
 
+/* Reads the contents of swapped-out PAGE into KVA, leaving its
+ * swap slot in place.  Used by fork to copy a page that is not
+ * resident. */
+bool
+anon_read_swapped (struct page *page, void *kva) {
+	struct anon_page *anon_page = &page->anon;
+	if (anon_page->zswap.zpage != NULL)
+		return zswap_load (&anon_page->zswap, kva);
+	if (anon_page->slot == BITMAP_ERROR)
+		return false;
+
+	lock_acquire (&swap_lock);
+	struct swap_cache_entry *e = cache_find (anon_page->slot);
+	if (e != NULL)
+		memcpy (kva, e->kva, PGSIZE);
+	else
+		slot_read (anon_page->slot, kva);
+	lock_release (&swap_lock);
 	return true;
 }
 
@@ -112,17 +316,279 @@ anon_swap_out (struct page *page) {
 static void
 anon_destroy (struct page *page) {
 	struct anon_page *anon_page = &page->anon;
+	zswap_free (&anon_page->zswap);
 	if (anon_page->slot != BITMAP_ERROR) {
 		lock_acquire (&swap_lock);
-		bitmap_reset (swap_table, anon_page->slot);
+		slot_free (anon_page->slot);
 		lock_release (&swap_lock);
 		anon_page->slot = BITMAP_ERROR;
 	}
 
 	if (page->frame != NULL) {
+		/* Unmapping part of a huge page needs 4 kB mappings. */
+		if (page->frame->huge)
+			vm_split_huge_frame (page->frame);
 		if (page->owner != NULL)
 			pml4_clear_page (page->owner->pml4, page->va);
-		page->frame->page = NULL;
-		page->frame = NULL;
+		vm_frame_detach (page);
+	}
+}
+
+/* Frees the swap slots of the swapped-out anonymous pages of SPT,
+ * which is being torn down, under one acquisition of SWAP_LOCK
+ * instead of one per page, and returns how many were freed.  Pages
+ * still resident, including any being swapped out right now, are
+ * left to anon_destroy(). */
+size_t
+anon_release_swap (struct supplemental_page_table *spt) {
+	struct hash_iterator it;
+	size_t cnt = 0;
+
+	lock_acquire (&swap_lock);
+	hash_first (&it, &spt->page_map);
+	while (hash_next (&it)) {
+		struct page *page = hash_entry (hash_cur (&it), struct page, spt_elem);
+
+		if (page->operations != &anon_ops || page->frame != NULL
+			|| page->anon.slot == BITMAP_ERROR)
+			continue;
+		slot_free (page->anon.slot);
+		page->anon.slot = BITMAP_ERROR;
+		cnt++;
+	}
+	lock_release (&swap_lock);
+	return cnt;
+}
+
+/* Takes a free cluster from the device of highest priority that
+ * has one, rotating among devices of equal priority.  Returns its
+ * index, or BITMAP_ERROR if every cluster is in use. */
+static size_t
+cluster_alloc (void) {
+	for (size_t g = 0, n; g < swap_dev_cnt; g += n) {
+		for (n = 1; g + n < swap_dev_cnt
+				&& swap_devs[g + n].prio == swap_devs[g].prio; n++)
+			continue;
+		for (size_t i = 0; i < n; i++) {
+			struct swap_dev *d = &swap_devs[g + (stripe_next + i) % n];
+			size_t idx = bitmap_scan (cluster_used, d->first, 1, false);
+
+			if (idx != BITMAP_ERROR && idx < d->first + d->cnt) {
+				bitmap_mark (cluster_used, idx);
+				stripe_next += i + 1;
+				return idx;
+			}
+		}
+	}
+	return BITMAP_ERROR;
+}
+
+/* Allocates a swap slot for PAGE, preferably its own slot in the
+ * cluster for its window of virtual pages.  Returns BITMAP_ERROR if
+ * the swap disk is full. */
+static size_t
+slot_alloc (struct page *page) {
+	struct swap_cluster key, *c = NULL;
+	struct hash_elem *he;
+	size_t idx, slot;
+
+	key.owner = page->owner;
+	key.window = pg_no (page->va) / SWAP_CLUSTER;
+	he = hash_find (&cluster_map, &key.elem);
+	if (he != NULL)
+		c = hash_entry (he, struct swap_cluster, elem);
+	else {
+		idx = cluster_alloc ();
+		if (idx != BITMAP_ERROR) {
+			c = &clusters[idx];
+			c->owner = key.owner;
+			c->window = key.window;
+			c->used = 0;
+			hash_insert (&cluster_map, &c->elem);
+		}
+	}
+
+	if (c != NULL) {
+		slot = (c - clusters) * SWAP_CLUSTER + pg_no (page->va) % SWAP_CLUSTER;
+		if (!bitmap_test (swap_table, slot)) {
+			bitmap_mark (swap_table, slot);
+			slot_owners[slot] = page->owner;
+			c->used++;
+			slot_dev (slot)->used++;
+			clustered_cnt++;
+			return slot;
+		}
+	}
+
+	/* Any free slot, by device priority. */
+	slot = BITMAP_ERROR;
+	for (size_t i = 0; i < swap_dev_cnt && slot == BITMAP_ERROR; i++) {
+		struct swap_dev *d = &swap_devs[i];
+		size_t s = bitmap_scan (swap_table, d->first * SWAP_CLUSTER, 1, false);
+
+		if (s != BITMAP_ERROR && s < (d->first + d->cnt) * SWAP_CLUSTER)
+			slot = s;
+	}
+	if (slot == BITMAP_ERROR)
+		return BITMAP_ERROR;
+	bitmap_mark (swap_table, slot);
+	slot_owners[slot] = page->owner;
+	slot_dev (slot)->used++;
+	c = &clusters[slot / SWAP_CLUSTER];
+	if (c->used++ == 0) {
+		bitmap_mark (cluster_used, slot / SWAP_CLUSTER);
+		c->owner = NULL;
+	}
+	scattered_cnt++;
+	return slot;
+}
+
+/* Frees SLOT, and its cluster once that is empty. */
+static void
+slot_free (size_t slot) {
+	struct swap_cluster *c = &clusters[slot / SWAP_CLUSTER];
+	struct swap_cache_entry *e = cache_find (slot);
+
+	if (e != NULL)
+		cache_drop (e);
+	bitmap_reset (swap_table, slot);
+	slot_dev (slot)->used--;
+	if (--c->used == 0) {
+		if (c->owner != NULL)
+			hash_delete (&cluster_map, &c->elem);
+		bitmap_reset (cluster_used, slot / SWAP_CLUSTER);
+	}
+}
+
+/* Returns the device SLOT is on. */
+static struct swap_dev *
+slot_dev (size_t slot) {
+	size_t cluster = slot / SWAP_CLUSTER;
+
+	for (size_t i = 0; i < swap_dev_cnt; i++)
+		if (cluster >= swap_devs[i].first
+			&& cluster < swap_devs[i].first + swap_devs[i].cnt)
+			return &swap_devs[i];
+	NOT_REACHED ();
+}
+
+/* Returns the first sector of SLOT on device D. */
+static disk_sector_t
+slot_sector (const struct swap_dev *d, size_t slot) {
+	return (slot - d->first * SWAP_CLUSTER) * (PGSIZE / DISK_SECTOR_SIZE);
+}
+
+/* Reads SLOT from its swap device into KVA. */
+static void
+slot_read (size_t slot, void *kva) {
+	struct swap_dev *d = slot_dev (slot);
+	disk_sector_t base = slot_sector (d, slot);
+
+	for (size_t i = 0; i < PGSIZE / DISK_SECTOR_SIZE; i++)
+		disk_read (d->disk, base + (disk_sector_t) i,
+			(uint8_t *) kva + i * DISK_SECTOR_SIZE);
+	d->read_cnt++;
+}
+
+/* Writes the page at KVA to SLOT on its swap device. */
+static void
+slot_write (size_t slot, const void *kva) {
+	struct swap_dev *d = slot_dev (slot);
+	disk_sector_t base = slot_sector (d, slot);
+
+	for (size_t i = 0; i < PGSIZE / DISK_SECTOR_SIZE; i++)
+		disk_write (d->disk, base + (disk_sector_t) i,
+			(const uint8_t *) kva + i * DISK_SECTOR_SIZE);
+}
+
+/* Reads SLOT into KVA and, in the same pass over the disk, the
+ * other slots in its cluster in use by the same process into the
+ * swap cache. */
+static void
+read_cluster (size_t slot, void *kva) {
+	size_t first = slot / SWAP_CLUSTER * SWAP_CLUSTER;
+
+	for (size_t s = first; s < first + SWAP_CLUSTER; s++) {
+		if (s == slot) {
+			slot_read (s, kva);
+			continue;
+		}
+		if (!bitmap_test (swap_table, s) || bitmap_test (swap_writing, s)
+			|| slot_owners[s] != slot_owners[slot] || cache_find (s) != NULL)
+			continue;
+
+		struct swap_cache_entry *e = list_entry (list_back (&swap_cache_lru),
+				struct swap_cache_entry, elem);
+		if (e->kva == NULL) {
+			e->kva = palloc_get_page (PAL_TAG (MEM_SWAP));
+			if (e->kva == NULL)
+				continue;
+		}
+		slot_read (s, e->kva);
+		e->slot = s;
+		list_remove (&e->elem);
+		list_push_front (&swap_cache_lru, &e->elem);
+		readahead_cnt++;
+	}
+}
+
+/* Returns the swap cache entry holding SLOT, or NULL. */
+static struct swap_cache_entry *
+cache_find (size_t slot) {
+	for (size_t i = 0; i < SWAP_CACHE_CNT; i++)
+		if (swap_cache[i].slot == slot)
+			return &swap_cache[i];
+	return NULL;
+}
+
+/* Empties E, making it the first to be reused. */
+static void
+cache_drop (struct swap_cache_entry *e) {
+	e->slot = BITMAP_ERROR;
+	list_remove (&e->elem);
+	list_push_back (&swap_cache_lru, &e->elem);
+}
+
+static uint64_t
+cluster_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct swap_cluster *c = hash_entry (e, struct swap_cluster, elem);
+	return hash_bytes (&c->owner, sizeof c->owner)
+		^ hash_bytes (&c->window, sizeof c->window);
+}
+
+static bool
+cluster_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	const struct swap_cluster *a = hash_entry (a_, struct swap_cluster, elem);
+	const struct swap_cluster *b = hash_entry (b_, struct swap_cluster, elem);
+
+	if (a->owner != b->owner)
+		return a->owner < b->owner;
+	return a->window < b->window;
+}
+
+/* Prints how many pages each swap tier took and served. */
+void
+vm_anon_print_stats (void) {
+	unsigned long long in = in_zswap_cnt + in_disk_cnt;
+
+	if (out_zswap_cnt + out_disk_cnt == 0)
+		return;
+	printf ("Swap: %llu pages out (%llu to zswap, %llu to disk), "
+			"%llu in (%llu from zswap, %llu from disk, %llu%% zswap hits)\n",
+			out_zswap_cnt + out_disk_cnt, out_zswap_cnt, out_disk_cnt,
+			in, in_zswap_cnt, in_disk_cnt, in ? in_zswap_cnt * 100 / in : 0);
+	if (out_disk_cnt > 0) {
+		printf ("Swap disk: %llu clustered, %llu scattered slots; "
+				"%llu pages read ahead, %llu swap cache hits\n",
+				clustered_cnt, scattered_cnt, readahead_cnt, cache_hit_cnt);
+		for (size_t i = 0; i < swap_dev_cnt; i++) {
+			const struct swap_dev *d = &swap_devs[i];
+			printf ("Swap device hd%d:%d, priority %d: %zu of %zu slots used, "
+					"%llu pages written, %llu read\n",
+					d->chan, d->dev, d->prio, d->used, d->cnt * SWAP_CLUSTER,
+					d->write_cnt, d->read_cnt);
+		}
 	}
+	zswap_print_stats ();
 }
@@ -4,12 +4,16 @@
 #include "vm/file.h"
 
 #include <string.h>
+#include <syscall-nr.h>
 
+#include "filesys/file.h"
+#include "filesys/inode.h"
 #include "threads/malloc.h"
 #include "threads/mmu.h"
 #include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#include "userprog/syscall.h"
 
 static bool file_backed_swap_in (struct page *page, void *kva);
 static bool file_backed_swap_out (struct page *page);
@@ -41,7 +45,9 @@ file_backed_initializer (struct page *page, enum vm_type type, void *kva) {
 	return true;
 }
 
-/* Swap in the page by read contents from the file. */
+/* Swap in the page by read contents from the file.  Mapped file
+ * pages are loaded through the page cache by vm_claim_shared()
+ * instead, so this only serves callers that want a private copy. */
 static bool
 file_backed_swap_in (struct page *page, void *kva) {
 	struct file_page *file_page = &page->file;
@@ -55,24 +61,19 @@ file_backed_swap_in (struct page *page, void *kva) {
 	return true;
 }
 
-/* Swap out the page by writeback contents to the file. */
+/* Swap out the page by unmapping it from its page cache frame.
+ * The dirty bit goes with it to the cache, which writes the frame
+ * back once, when the last mapping is gone or the frame is
+ * evicted. */
 static bool
 file_backed_swap_out (struct page *page) {
-	struct file_page *file_page = &page->file;
 	struct thread *t = (page->owner != NULL) ? page->owner : thread_current ();
 
-	if (page->frame != NULL && file_page->file != NULL && page->writable &&
-		pml4_is_dirty (t->pml4, page->va)) {
-		file_write_at (file_page->file, page->frame->kva,
-			file_page->read_bytes, file_page->ofs);
-		pml4_set_dirty (t->pml4, page->va, false);
-	}
+	if (page->frame == NULL)
+		return true;
 
-	if (page->frame != NULL) {
-		pml4_clear_page (t->pml4, page->va);
-		page->frame->page = NULL;
-		page->frame = NULL;
-	}
+	pml4_clear_page (t->pml4, page->va);
+	vm_frame_detach (page);
 
 	return true;
 }
@@ -83,42 +84,32 @@ file_backed_destroy (struct page *page) {
 	(void) file_backed_swap_out (page);
 }
 
-struct mmap_page_aux {
-	struct file *file;
-	off_t ofs;
-	size_t read_bytes;
-	size_t zero_bytes;
-};
-
+/* Sets up PAGE of a file mapping from AUX.  The page itself is
+ * loaded into the page cache by vm_claim_shared(). */
 static bool
 lazy_load_mmap (struct page *page, void *aux_) {
-	struct mmap_page_aux *aux = aux_;
+	struct segment_aux *aux = aux_;
 	struct file_page *file_page = &page->file;
 
 	file_page->file = aux->file;
 	file_page->ofs = aux->ofs;
 	file_page->read_bytes = aux->read_bytes;
 	file_page->zero_bytes = aux->zero_bytes;
-
 	free (aux);
 
-	if (file_page->file == NULL)
-		return false;
-
-	if (file_read_at (file_page->file, page->frame->kva, file_page->read_bytes,
-			file_page->ofs) != (int) file_page->read_bytes)
-		return false;
-	memset ((uint8_t *) page->frame->kva + file_page->read_bytes, 0,
-			file_page->zero_bytes);
-	return true;
+	return file_page->file != NULL;
 }
 
-/* Do the mmap */
+/* Do the mmap.  The mapping is a single region; its pages are
+ * created as they are touched, or all at once with MAP_POPULATE in
+ * WRITABLE.  With MAP_ANONYMOUS, the region is zero-filled memory
+ * and FILE and OFFSET are ignored. */
 void *
 do_mmap (void *addr, size_t length, int writable,
 		struct file *file, off_t offset) {
 	struct thread *t = thread_current ();
 	struct supplemental_page_table *spt = &t->spt;
+	bool anon = (writable & MAP_ANONYMOUS) != 0;
 
 	if (addr == NULL)
 		return NULL;
@@ -126,9 +117,9 @@ do_mmap (void *addr, size_t length, int writable,
 		return NULL;
 	if (length == 0)
 		return NULL;
-	if (file == NULL)
+	if (file == NULL && !anon)
 		return NULL;
-	if (offset < 0 || pg_ofs (offset) != 0)
+	if (!anon && (offset < 0 || pg_ofs (offset) != 0))
 		return NULL;
 
 	/* Refuse to map over kernel address space. */
@@ -139,73 +130,85 @@ do_mmap (void *addr, size_t length, int writable,
 	if (!is_user_vaddr ((void *) start) || !is_user_vaddr ((void *) end))
 		return NULL;
 
-	int file_len = file_length (file);
-	if (file_len <= 0)
+	int file_len = anon ? 0 : file_length (file);
+	if (file_len <= 0 && !anon)
 		return NULL;
 
 	size_t page_cnt = (length + PGSIZE - 1) / PGSIZE;
 	if (page_cnt == 0)
 		return NULL;
 
-	/* Check overlap with existing mappings. */
-	for (size_t i = 0; i < page_cnt; i++) {
-		void *va = (uint8_t *) addr + i * PGSIZE;
-		if (spt_find_page (spt, va) != NULL)
+	/* Check overlap with other regions, and with pages that belong
+	 * to none, such as the stack. */
+	uint8_t *limit = (uint8_t *) addr + page_cnt * PGSIZE;
+	if (vma_overlap (spt, addr, limit) != NULL)
+		return NULL;
+	for (uint8_t *va = addr; va < limit; va += PGSIZE) {
+		if (spt_lookup_page (spt, va) != NULL)
 			return NULL;
 		if (pml4_get_page (t->pml4, va) != NULL)
 			return NULL;
 	}
 
-	struct mmap_region *mr = malloc (sizeof *mr);
-	if (mr == NULL)
-		return NULL;
-	*mr = (struct mmap_region) {
-		.addr = addr,
-		.length = length,
-		.page_cnt = page_cnt,
-		.file = file_reopen (file),
-		.offset = offset,
-		.writable = writable != 0,
+	size_t file_left = 0;
+	if ((int64_t) offset < file_len)
+		file_left = (size_t) file_len - (size_t) offset;
+
+	struct vma vma = {
+		.start = addr,
+		.end = limit,
+		.type = anon ? VM_ANON : VM_FILE,
+		.writable = (writable & ~(MAP_ANONYMOUS | MAP_POPULATE)) != 0,
+		.init = anon ? NULL : lazy_load_mmap,
+		.file = anon ? NULL : file_reopen (file),
+		.ofs = anon ? 0 : offset,
+		.read_bytes = file_left < page_cnt * PGSIZE ? file_left
+			: page_cnt * PGSIZE,
+		.mapped = true,
 	};
-	if (mr->file == NULL) {
-		free (mr);
+	if (vma.file == NULL && !anon)
 		return NULL;
-	}
-	list_push_back (&t->mmap_list, &mr->elem);
-
-	for (size_t i = 0; i < page_cnt; i++) {
-		void *va = (uint8_t *) addr + i * PGSIZE;
-		off_t ofs = offset + (off_t) (i * PGSIZE);
-
-		size_t file_left = 0;
-		if ((int64_t) ofs < file_len)
-			file_left = (size_t) file_len - (size_t) ofs;
-
-		size_t read_bytes = file_left < PGSIZE ? file_left : PGSIZE;
-		size_t zero_bytes = PGSIZE - read_bytes;
-
-		struct mmap_page_aux *aux = malloc (sizeof *aux);
-		if (aux == NULL)
-			goto fail;
-		*aux = (struct mmap_page_aux) {
-			.file = mr->file,
-			.ofs = ofs,
-			.read_bytes = read_bytes,
-			.zero_bytes = zero_bytes,
-		};
-
-		if (!vm_alloc_page_with_initializer (VM_FILE, va, writable != 0,
-				lazy_load_mmap, aux)) {
-			free (aux);
-			goto fail;
-		}
-	}
 
+	/* A writable mapping stores into the page-cache frames that the
+	 * text of running executables maps, so refuse one of a file
+	 * whose writes are denied.  Checking and adding under
+	 * filesys_lock keeps exec, which denies writes and then checks
+	 * for writable mappings under it too, from slipping in between. */
+	bool ok;
+	lock_acquire (&filesys_lock);
+	ok = !(vma.writable && !anon
+			&& inode_is_write_denied (file_get_inode (vma.file)))
+		&& vma_add (spt, &vma) != NULL;
+	if (!ok)
+		file_close (vma.file);
+	lock_release (&filesys_lock);
+	if (!ok)
+		return NULL;
+	if (writable & MAP_POPULATE)
+		vm_populate (addr, limit);
 	return addr;
+}
 
-fail:
-	do_munmap (addr);
-	return NULL;
+/* Maps PAGE_CNT pages of FILE from OFFSET at ADDR, read-only, as
+ * part of the image of an executable.  Like a file mapping, the
+ * pages are shared through the page cache, here with every process
+ * running the same executable, and being clean are simply dropped
+ * when evicted.  The region takes over FILE, unless this fails. */
+bool
+file_map_text (void *addr, size_t page_cnt, struct file *file, off_t offset) {
+	struct vma vma = {
+		.start = addr,
+		.end = (uint8_t *) addr + page_cnt * PGSIZE,
+		.type = VM_FILE,
+		.writable = false,
+		.init = lazy_load_mmap,
+		.file = file,
+		.ofs = offset,
+		.read_bytes = page_cnt * PGSIZE,
+	};
+
+	ASSERT (pg_ofs (addr) == 0 && pg_ofs (offset) == 0);
+	return vma_add (&thread_current ()->spt, &vma) != NULL;
 }
 
 /* Do the munmap */
@@ -213,27 +216,22 @@ void
 do_munmap (void *addr) {
 	struct thread *t = thread_current ();
 	struct supplemental_page_table *spt = &t->spt;
+	struct vma *vma = vma_find (spt, addr);
 
-	struct mmap_region *mr = NULL;
-	for (struct list_elem *e = list_begin (&t->mmap_list);
-		e != list_end (&t->mmap_list); e = list_next (e)) {
-		struct mmap_region *cand = list_entry (e, struct mmap_region, elem);
-		if (cand->addr == addr) {
-			mr = cand;
-			break;
-		}
-	}
-	if (mr == NULL)
+	if (vma == NULL || vma->start != addr || !vma->mapped)
 		return;
 
-	for (size_t i = 0; i < mr->page_cnt; i++) {
-		void *va = (uint8_t *) mr->addr + i * PGSIZE;
-		struct page *page = spt_find_page (spt, va);
+	/* Unmap the whole range with one TLB flush; the dirty bits stay
+	 * in the PTEs for the pages to pass on to the page cache as
+	 * they are dropped.  Then free the page tables. */
+	if (t->pml4 != NULL)
+		pml4_clear_range (t->pml4, vma->start, vma->end);
+	for (uint8_t *va = vma->start; va < (uint8_t *) vma->end; va += PGSIZE) {
+		struct page *page = spt_lookup_page (spt, va);
 		if (page != NULL)
 			spt_remove_page (spt, page);
 	}
-
-	list_remove (&mr->elem);
-	file_close (mr->file);
-	free (mr);
+	if (t->pml4 != NULL)
+		pml4_unmap_range (t->pml4, vma->start, vma->end);
+	vma_destroy (spt, vma);
 }
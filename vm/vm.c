@@ -1,23 +1,185 @@
 /* vm.c: Generic interface for virtual memory objects. */
 
 #include "threads/malloc.h"
+#include <round.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "threads/palloc.h"
 #include "threads/mmu.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#include "devices/timer.h"
 #include "filesys/file.h"
+#include "filesys/inode.h"
+#include "filesys/page_cache.h"
+#include "userprog/syscall.h"
 #include "vm/vm.h"
+#include <syscall-nr.h>
 #include "vm/inspect.h"
+#include "intrinsic.h"
 
 static uint64_t page_hash(const struct hash_elem *e, void *aux UNUSED);
 static bool page_less(const struct hash_elem *a, const struct hash_elem *b,
 					  void *aux UNUSED);
 static void spt_destroy_page(struct hash_elem *e, void *aux UNUSED);
+static void vm_release_page(struct page *page);
+static void kswapd(void *aux UNUSED);
+static void ksmd(void *aux UNUSED);
+static void flushd(void *aux UNUSED);
+static uint64_t ksm_hash(const struct hash_elem *e, void *aux UNUSED);
+static bool ksm_less(const struct hash_elem *a, const struct hash_elem *b,
+					 void *aux UNUSED);
 
 static struct list frame_table;
 static struct lock frame_lock;
-static struct list_elem *clock_hand;
+
+/* Page replacement.  Every frame that backs an evictable page is
+ * on one of two LRU lists, most recently added at the front.  New
+ * pages start on the inactive list; a page found referenced there
+ * is promoted to the active list, and the active list is aged back
+ * onto the inactive list to keep it at least a third of the total.
+ * Victims come from the back of the inactive list, preferring
+ * pages that can be dropped without a write (clean file pages)
+ * over those that need one (anonymous and dirty file pages).
+ * EVICT_CLOCK counts evictions; a page remembers its value when it
+ * goes out, and if it comes back within as many evictions as there
+ * are resident pages it was part of the working set and returns
+ * straight to the active list. */
+static struct list active_list, inactive_list;
+static size_t active_cnt, inactive_cnt;
+static uint64_t evict_clock;
+#define LRU_SCAN_MAX 32
+static unsigned long long activate_cnt;     /* Inactive -> active. */
+static unsigned long long deactivate_cnt;   /* Active -> inactive. */
+static unsigned long long evict_clean_cnt;  /* Victims needing no write. */
+static unsigned long long evict_dirty_cnt;  /* Victims needing a write. */
+static unsigned long long refault_cnt;      /* Evicted pages faulted back. */
+static unsigned long long refault_ws_cnt;   /* ...within the working set. */
+
+/* Fault-around.  A fault on a page of a file-backed region also
+ * maps up to the region's RA_PAGES neighbours, read from the file
+ * in one go.  The window adapts per region between 1 and
+ * FAULT_AROUND_MAX pages; both bounds are powers of two. */
+#define FAULT_AROUND_INIT 4
+#define FAULT_AROUND_MAX 16
+static unsigned long long fault_around_cnt;   /* Batched reads. */
+static unsigned long long fault_around_pages; /* Neighbours mapped. */
+
+/* Pages loaded, dropped and marked cold by vm_madvise(). */
+static unsigned long long madv_willneed_cnt, madv_dontneed_cnt, madv_cold_cnt;
+
+/* MAP_POPULATE.  File data is read POPULATE_BATCH pages at a time,
+ * in one read each. */
+#define POPULATE_BATCH 64
+static unsigned long long populate_cnt;        /* Pages loaded. */
+static unsigned long long populate_batch_cnt;  /* ...of them by batched reads. */
+
+/* Frames in FRAME_TABLE that back no page, ready for reuse, and
+ * frames that may not be evicted right now.  A frame is pinned
+ * from the moment vm_get_frame() hands it out until its page is
+ * loaded, and from the moment it is chosen as a victim until its
+ * page has been written out.  Threads that need a pinned frame to
+ * settle wait on UNPIN_COND. */
+static struct list free_frames;
+static size_t free_frame_cnt;
+static size_t pinned_cnt;
+static struct condition unpin_cond;
+
+/* Background page-out.  When vm_get_frame() leaves fewer than
+ * LOW_WMARK frames free, counting both FREE_FRAMES and the user
+ * pool, it wakes kswapd, which evicts until HIGH_WMARK frames are
+ * free.  Faults then find a free frame waiting instead of writing
+ * a victim to swap themselves; they evict directly only when
+ * kswapd falls behind. */
+static struct semaphore kswapd_sema;
+static bool kswapd_awake;
+static size_t low_wmark, high_wmark;
+static unsigned long long kswapd_wake_cnt;  /* Times kswapd was woken. */
+static unsigned long long kswapd_evict_cnt; /* Pages it evicted. */
+static unsigned long long direct_evict_cnt; /* Pages evicted by faults. */
+
+/* Resident-set limits.  A process's RSS counts the private frames
+ * charged to it, those on the LRU lists that hold its pages; frames
+ * shared through the page cache or KSM are not charged to anyone.
+ * Once its RSS reaches its limit, a process's faults evict its own
+ * pages before taking a frame.  The limit is inherited across fork
+ * and kept across exec; the first process gets VM_RSS_LIMIT. */
+size_t vm_rss_limit;
+static unsigned long long local_evict_cnt;  /* Pages evicted locally. */
+
+/* Background write-back.  Every WRITEBACK_INTERVAL ticks, flushd
+ * writes the page cache frames that mappings have dirtied back to
+ * their files, up to WRITEBACK_BATCH at a time in file order, and
+ * marks them clean, so that evicting them later costs no write.
+ * msync() does the same on demand for a range of one process.
+ * Only frames in WRITEBACK_FRAMES can be dirty: a frame joins it
+ * when it is mapped writable and leaves once it is clean with no
+ * writable mapping, or is evicted.  With no writable file mappings
+ * the list is empty and flushd does not take FRAME_LOCK at all. */
+#define WRITEBACK_INTERVAL TIMER_FREQ
+#define WRITEBACK_BATCH 64
+#define WRITEBACK_ROUNDS 16
+static struct list writeback_frames;        /* By wb_elem, under FRAME_LOCK. */
+static unsigned long long flushd_pass_cnt;  /* Times flushd scanned. */
+static unsigned long long flushd_page_cnt;  /* Pages it wrote back. */
+static unsigned long long msync_page_cnt;   /* Pages msync() wrote back. */
+
+/* Address-space teardown at exit and exec: pages written back,
+ * frames and swap slots released in bulk. */
+static unsigned long long teardown_wb_cnt;
+static unsigned long long teardown_frame_cnt;
+static unsigned long long teardown_slot_cnt;
+
+/* Page fault accounting.  Every fault that is handled is counted
+ * in the faulting thread by kind, and its handling time, in TSC
+ * cycles, goes into a log2 histogram.  With -pfstat, each process
+ * prints them when it exits. */
+bool vm_fault_report;
+
+/* Shared zero frame.  A read fault on an anonymous page that has
+ * never been touched and whose contents are all zeros maps this
+ * frame read-only instead of allocating one; the first write
+ * fault replaces it with a private frame. */
+static void *zero_kva;
+static unsigned long long zero_map_cnt;     /* Read faults served. */
+static unsigned long long zero_cow_cnt;     /* Later written. */
+
+/* Transparent huge pages.  With -thp, the first fault in a 2 MB
+ * aligned region whose 4 kB pages are all untouched, writable and
+ * anonymous maps the whole region at once with one PS
+ * page-directory entry over 512 contiguous frames.  The region
+ * still has one struct page per 4 kB, but they share a single
+ * struct frame.  Evicting it, or destroying one of its pages,
+ * splits it back into 4 kB frames. */
+bool vm_thp_enabled;
+static unsigned long long thp_fault_cnt;    /* Huge pages mapped. */
+static unsigned long long thp_split_cnt;    /* Huge pages split. */
+static unsigned long long thp_fallback_cnt; /* No aligned frames free. */
+#define HUGE_PAGE_CNT (LARGE_PGSIZE / PGSIZE)
+
+/* Kernel same-page merging.  With -ksm=N, the ksmd thread wakes
+ * every KSM_INTERVAL ticks and checksums the next N frames in the
+ * frame table.  An anonymous page whose checksum did not change
+ * since the previous pass is merged with an identical page: both
+ * are remapped read-only to one shared frame that has a reference
+ * count, sits in KSM_STABLE keyed by its checksum, and is never
+ * evicted.  Identical pages not yet shared are found through
+ * KSM_UNSTABLE, which remembers the last frame seen with each
+ * checksum bucket during the current pass.  A write fault gives
+ * the writer a private copy again. */
+size_t vm_ksm_scan_rate;
+#define KSM_INTERVAL (TIMER_FREQ / 10)
+#define KSM_UNSTABLE_CNT 256
+static struct hash ksm_stable;
+static struct frame *ksm_unstable[KSM_UNSTABLE_CNT];
+static struct list_elem *ksm_cursor;
+static size_t ksm_shared_cnt;               /* Shared frames. */
+static size_t ksm_sharing_cnt;              /* Pages mapping them. */
+static unsigned long long ksm_scan_cnt;     /* Frames scanned. */
+static unsigned long long ksm_merge_cnt;    /* Pages merged. */
+static unsigned long long ksm_cow_cnt;      /* Merged pages written. */
 
 /* Initializes the virtual memory subsystem by invoking each subsystem's
  * intialize codes. */
@@ -25,7 +187,12 @@ void vm_init(void)
 {
 	list_init(&frame_table);
 	lock_init(&frame_lock);
-	clock_hand = NULL;
+	list_init(&active_list);
+	list_init(&inactive_list);
+	list_init(&free_frames);
+	list_init(&writeback_frames);
+	cond_init(&unpin_cond);
+	sema_init(&kswapd_sema, 0);
 
 	vm_anon_init();
 	vm_file_init();
@@ -34,6 +201,25 @@ void vm_init(void)
 #endif
 	register_inspect_intr();
 	/* DO NOT MODIFY UPPER LINES. */
+	page_cache_init();
+
+	low_wmark = palloc_free_cnt(PAL_USER) / 64;
+	if (low_wmark < 4)
+		low_wmark = 4;
+	high_wmark = low_wmark * 2;
+	zero_kva = palloc_get_page(PAL_USER | PAL_ZERO);
+	if (zero_kva == NULL)
+		PANIC("vm_init: cannot allocate zero frame");
+	if (thread_create("kswapd", PRI_DEFAULT, kswapd, NULL) == TID_ERROR)
+		PANIC("vm_init: cannot start kswapd");
+	if (vm_ksm_scan_rate > 0)
+	{
+		hash_init(&ksm_stable, ksm_hash, ksm_less, NULL);
+		if (thread_create("ksmd", PRI_MIN, ksmd, NULL) == TID_ERROR)
+			PANIC("vm_init: cannot start ksmd");
+	}
+	if (thread_create("flushd", PRI_MIN, flushd, NULL) == TID_ERROR)
+		PANIC("vm_init: cannot start flushd");
 }
 
 /* Get the type of the page. This function is useful if you want to know the
@@ -73,13 +259,32 @@ static void
 spt_destroy_page(struct hash_elem *e, void *aux UNUSED)
 {
 	struct page *page = hash_entry(e, struct page, spt_elem);
-	vm_dealloc_page(page);
+	vm_release_page(page);
 }
 
 /* Helpers */
 static struct frame *vm_get_victim(void);
+static void vm_take_victim(struct frame *victim);
+static struct frame *vm_get_local_victim(struct thread *t);
 static bool vm_do_claim_page(struct page *page);
-static struct frame *vm_evict_frame(void);
+static bool vm_claim_pinned(struct page *page);
+static bool vm_claim_shared(struct page *page);
+static bool vm_cache_evict(struct frame *frame, bool only_unmapped);
+static bool vm_claim_huge(struct page *page, bool *success);
+static void vm_unclaim_huge(struct frame *frame, size_t loaded);
+static bool vm_map_zero(struct page *page);
+static bool vm_ksm_unshare(struct page *page);
+static void ksm_put(struct frame *frame);
+static void vm_free_huge_frame(struct frame *frame);
+static void vm_page_out(struct frame *victim);
+static void vm_pin_frame(struct frame *frame);
+static void vm_unpin_frame(struct frame *frame);
+static void vm_wait_unpinned(struct page *page);
+static void lru_add(struct frame *frame, enum frame_lru lru);
+static void lru_del(struct frame *frame);
+static size_t vm_free_frames(void);
+static struct page *vm_alloc_vma_page(struct vma *vma, void *va);
+static bool vm_fault_around(struct page *page, bool *success);
 
 /* Create the pending page object with initializer. If you want to create a
  * page, do not create it directly and make it through this function or
@@ -95,14 +300,14 @@ bool vm_alloc_page_with_initializer(enum vm_type type, void *upage, bool writabl
 	struct page *page = NULL;
 
 	/* Check wheter the upage is already occupied or not. */
-	if (spt_find_page(spt, upage) == NULL)
+	if (spt_lookup_page(spt, upage) == NULL)
 	{
 		/* TODO: Create the page, fetch the initialier according to the VM type,
 		 * TODO: and then create "uninit" page struct by calling uninit_new. You
 		 * TODO: should modify the field after calling the uninit_new. */
 
 		/* TODO: Insert the page into the spt. */
-		page = malloc(sizeof *page);
+		page = malloc_tagged(sizeof *page, MEM_SPT);
 		if (page == NULL)
 			goto err;
 
@@ -132,16 +337,32 @@ err:
 	return false;
 }
 
-/* Find VA from spt and return page. On error, return NULL. */
+/* Find VA from spt and return page. On error, return NULL.
+ * Pages of a region are created here on first use, but only in the
+ * running process's own table. */
 struct page *
 spt_find_page(struct supplemental_page_table *spt UNUSED, void *va UNUSED)
+{
+	struct page *page = spt_lookup_page(spt, va);
+
+	if (page == NULL && spt == &thread_current()->spt)
+	{
+		struct vma *vma = vma_find(spt, va);
+		if (vma != NULL)
+			page = vm_alloc_vma_page(vma, pg_round_down(va));
+	}
+	return page;
+}
+
+/* Like spt_find_page(), but only returns pages that already exist. */
+struct page *
+spt_lookup_page(struct supplemental_page_table *spt, void *va)
 {
 	struct page *page = NULL;
 	struct page temp;
 	struct hash_elem *elem;
-	void *rounded = pg_round_down(va);
 
-	temp.va = rounded;
+	temp.va = pg_round_down(va);
 	elem = hash_find(&spt->page_map, &temp.spt_elem);
 	if (elem != NULL)
 		page = hash_entry(elem, struct page, spt_elem);
@@ -149,6 +370,37 @@ spt_find_page(struct supplemental_page_table *spt UNUSED, void *va UNUSED)
 	return page;
 }
 
+/* Creates the page at VA in region VMA of the running process. */
+static struct page *
+vm_alloc_vma_page(struct vma *vma, void *va)
+{
+	struct segment_aux *aux = NULL;
+	size_t ofs = (uint8_t *)va - (uint8_t *)vma->start;
+
+	if (vma->init != NULL)
+	{
+		aux = malloc_tagged(sizeof *aux, MEM_SPT);
+		if (aux == NULL)
+			return NULL;
+		aux->file = vma->file;
+		aux->ofs = vma->ofs + ofs;
+		aux->read_bytes = 0;
+		if (vma->read_bytes > ofs)
+			aux->read_bytes = vma->read_bytes - ofs < PGSIZE
+								  ? vma->read_bytes - ofs
+								  : PGSIZE;
+		aux->zero_bytes = PGSIZE - aux->read_bytes;
+		aux->data = NULL;
+	}
+	if (!vm_alloc_page_with_initializer(vma->type, va, vma->writable,
+										vma->init, aux))
+	{
+		free(aux);
+		return NULL;
+	}
+	return spt_lookup_page(&thread_current()->spt, va);
+}
+
 /* Insert PAGE into spt with validation. */
 bool spt_insert_page(struct supplemental_page_table *spt UNUSED,
 					 struct page *page UNUSED)
@@ -163,107 +415,683 @@ bool spt_insert_page(struct supplemental_page_table *spt UNUSED,
 void spt_remove_page(struct supplemental_page_table *spt, struct page *page)
 {
 	hash_delete(&spt->page_map, &page->spt_elem);
+	vm_release_page(page);
+}
+
+/* Deallocates PAGE once any page-out in progress on it has
+ * finished, keeping its frame pinned meanwhile so that kswapd
+ * cannot pick it while it is being torn down. */
+static void
+vm_release_page(struct page *page)
+{
+	struct frame *frame;
+
+	lock_acquire(&frame_lock);
+	vm_wait_unpinned(page);
+	frame = page->frame;
+	if (frame != NULL)
+	{
+		vm_pin_frame(frame);
+	}
+	lock_release(&frame_lock);
+
+	if (page->zero)
+		pml4_clear_page(page->owner->pml4, page->va);
 	vm_dealloc_page(page);
+	if (frame != NULL)
+		vm_unpin_frame(frame);
+}
+
+/* Puts FRAME at the front of list LRU and charges it to the
+ * process whose private page it holds, if any.  Must be called
+ * with FRAME_LOCK held. */
+static void
+lru_add(struct frame *frame, enum frame_lru lru)
+{
+	ASSERT(frame->lru == LRU_NONE);
+	frame->lru = lru;
+	frame->rss_owner = frame->page != NULL ? frame->page->owner : NULL;
+	if (frame->rss_owner != NULL)
+		frame->rss_owner->rss += frame->huge ? HUGE_PAGE_CNT : 1;
+	if (lru == LRU_ACTIVE)
+	{
+		list_push_front(&active_list, &frame->lru_elem);
+		active_cnt++;
+	}
+	else
+	{
+		list_push_front(&inactive_list, &frame->lru_elem);
+		inactive_cnt++;
+	}
+}
+
+/* Takes FRAME off its LRU list, if any.  Must be called with
+ * FRAME_LOCK held. */
+static void
+lru_del(struct frame *frame)
+{
+	if (frame->lru == LRU_NONE)
+		return;
+	list_remove(&frame->lru_elem);
+	if (frame->lru == LRU_ACTIVE)
+		active_cnt--;
+	else
+		inactive_cnt--;
+	frame->lru = LRU_NONE;
+	if (frame->rss_owner != NULL)
+		frame->rss_owner->rss -= frame->huge ? HUGE_PAGE_CNT : 1;
+	frame->rss_owner = NULL;
+}
+
+/* Moves FRAME to the front of list LRU. */
+static void
+lru_move(struct frame *frame, enum frame_lru lru)
+{
+	lru_del(frame);
+	lru_add(frame, lru);
+}
+
+/* Returns the page table that maps P. */
+static uint64_t *
+page_pml4(const struct page *p)
+{
+	return (p->owner != NULL) ? p->owner->pml4 : thread_current()->pml4;
+}
+
+/* Tests and clears the accessed bit of the page in FRAME, or of
+ * every page mapping it if it is in the page cache. */
+static bool
+lru_referenced(struct frame *frame)
+{
+	bool referenced = false;
+
+	if (frame->pc != NULL)
+	{
+		struct list *mappers = &frame->pc->mappers;
+		for (struct list_elem *e = list_begin(mappers);
+			 e != list_end(mappers); e = list_next(e))
+		{
+			struct page *p = list_entry(e, struct page, file.pc_elem);
+			if (pml4_is_accessed(page_pml4(p), p->va))
+			{
+				pml4_set_accessed(page_pml4(p), p->va, false);
+				referenced = true;
+			}
+		}
+		return referenced;
+	}
+
+	struct page *p = frame->page;
+	uint64_t *pml4 = page_pml4(p);
+
+	if (!pml4_is_accessed(pml4, p->va))
+		return false;
+	pml4_set_accessed(pml4, p->va, false);
+	return true;
+}
+
+/* Returns 0 if the page in FRAME can be dropped without writing it
+ * anywhere, 1 otherwise. */
+static int
+lru_cost(struct frame *frame)
+{
+	if (frame->pc != NULL)
+	{
+		struct list *mappers = &frame->pc->mappers;
+		if (frame->pc->dirty)
+			return 1;
+		for (struct list_elem *e = list_begin(mappers);
+			 e != list_end(mappers); e = list_next(e))
+		{
+			struct page *p = list_entry(e, struct page, file.pc_elem);
+			if (pml4_is_dirty(page_pml4(p), p->va))
+				return 1;
+		}
+		return 0;
+	}
+
+	struct page *p = frame->page;
+
+	if (VM_TYPE(p->operations->type) == VM_FILE &&
+		!pml4_is_dirty(page_pml4(p), p->va))
+		return 0;
+	return 1;
+}
+
+/* Moves frames from the back of the active list to the inactive
+ * list until the inactive list holds a third of all frames.
+ * Referenced frames get another round on the active list, unless
+ * FORCE. */
+static void
+lru_age_active(bool force)
+{
+	for (size_t n = 0; n < LRU_SCAN_MAX && !list_empty(&active_list); n++)
+	{
+		if (!force && inactive_cnt * 3 >= active_cnt + inactive_cnt)
+			break;
+
+		struct frame *f = list_entry(list_back(&active_list),
+									 struct frame, lru_elem);
+		if (lru_referenced(f) && !force)
+			lru_move(f, LRU_ACTIVE);
+		else
+		{
+			lru_move(f, LRU_INACTIVE);
+			deactivate_cnt++;
+		}
+	}
 }
 
-/* Get the struct frame, that will be evicted. */
+/* Looks for a victim among the frames at the back of the inactive
+ * list, promoting referenced frames unless IGNORE_REF. */
 static struct frame *
-vm_get_victim(void)
+lru_scan_inactive(bool ignore_ref)
 {
 	struct frame *victim = NULL;
-	if (list_empty(&frame_table))
-		return NULL;
-
-	if (clock_hand == NULL || clock_hand == list_end(&frame_table))
-		clock_hand = list_begin(&frame_table);
+	int victim_cost = 2;
+	size_t limit = inactive_cnt < LRU_SCAN_MAX ? inactive_cnt : LRU_SCAN_MAX;
+	struct list_elem *e = list_rbegin(&inactive_list);
 
-	size_t scanned = 0;
-	while (scanned < 2 * list_size(&frame_table))
+	for (size_t n = 0; n < limit && e != list_rend(&inactive_list); n++)
 	{
-		if (clock_hand == list_end(&frame_table))
-			clock_hand = list_begin(&frame_table);
-		struct frame *f = list_entry(clock_hand, struct frame, elem);
-		clock_hand = list_next(clock_hand);
-		scanned++;
+		struct frame *f = list_entry(e, struct frame, lru_elem);
+		e = list_prev(e);
 
-		if (f->page == NULL)
+		if (f->pinned)
 			continue;
-		struct page *p = f->page;
-		uint64_t *pml4 = (p->owner != NULL) ? p->owner->pml4 : thread_current()->pml4;
-		if (pml4_is_accessed(pml4, p->va))
+		if (lru_referenced(f) && !ignore_ref)
 		{
-			pml4_set_accessed(pml4, p->va, false);
+			lru_move(f, LRU_ACTIVE);
+			activate_cnt++;
 			continue;
 		}
-		victim = f;
-		break;
+
+		int cost = lru_cost(f);
+		if (cost < victim_cost)
+		{
+			victim = f;
+			victim_cost = cost;
+			if (cost == 0)
+				break;
+		}
+	}
+	return victim;
+}
+
+/* Get the struct frame, that will be evicted.  Must be called with
+ * FRAME_LOCK held.  The victim is returned pinned and off the LRU
+ * lists, and split into 4 kB frames first if it was a huge page:
+ * only its first 4 kB goes out, the rest stays resident as
+ * ordinary frames. */
+static struct frame *
+vm_get_victim(void)
+{
+	struct frame *victim = NULL;
+	ASSERT(lock_held_by_current_thread(&frame_lock));
+
+	/* Age normally first; if every candidate was referenced, age
+	 * harder, and finally take whatever is oldest. */
+	for (int pass = 0; pass < 3 && victim == NULL; pass++)
+	{
+		lru_age_active(pass > 0);
+		victim = lru_scan_inactive(pass > 1);
 	}
 
+	if (victim != NULL)
+		vm_take_victim(victim);
 	return victim;
 }
 
-/* Evict one page and return the corresponding frame.
- * Return NULL on error.*/
+/* Prepares VICTIM for eviction as vm_get_victim() describes.  Must
+ * be called with FRAME_LOCK held. */
+static void
+vm_take_victim(struct frame *victim)
+{
+	if (lru_cost(victim) == 0)
+		evict_clean_cnt++;
+	else
+		evict_dirty_cnt++;
+	if (victim->huge)
+		vm_split_huge_frame(victim);
+	lru_del(victim);
+	evict_clock++;
+	if (victim->page != NULL)
+		victim->page->evicted_at = evict_clock;
+	vm_pin_frame(victim);
+}
+
+/* Like vm_get_victim(), but only among the frames charged to T,
+ * for a process at its resident-set limit: the oldest one not
+ * referenced since it was last looked at, or failing that the
+ * oldest.  Returns NULL if T has no frame that can be evicted. */
 static struct frame *
-vm_evict_frame(void)
+vm_get_local_victim(struct thread *t)
 {
-	struct frame *victim = vm_get_victim();
-	if (victim == NULL || victim->page == NULL)
-		return victim;
+	struct list *lists[] = {&inactive_list, &active_list};
+	struct frame *victim = NULL, *oldest = NULL;
 
-	struct page *page = victim->page;
-	if (!swap_out(page))
-		PANIC("vm_evict_frame: swap_out failed");
+	ASSERT(lock_held_by_current_thread(&frame_lock));
 
-	ASSERT(victim->page == NULL);
+	for (int i = 0; i < 2 && victim == NULL; i++)
+		for (struct list_elem *e = list_rbegin(lists[i]);
+			 e != list_rend(lists[i]); e = list_prev(e))
+		{
+			struct frame *f = list_entry(e, struct frame, lru_elem);
+
+			if (f->rss_owner != t || f->pinned)
+				continue;
+			if (oldest == NULL)
+				oldest = f;
+			if (!lru_referenced(f))
+			{
+				victim = f;
+				break;
+			}
+		}
+	if (victim == NULL)
+		victim = oldest;
+	if (victim != NULL)
+		vm_take_victim(victim);
 	return victim;
 }
 
+/* Writes out the page in pinned VICTIM, then unpins it, which puts
+ * it on the free list.  Called without FRAME_LOCK so that other
+ * faults can proceed during the write. */
+static void
+vm_page_out(struct frame *victim)
+{
+	ASSERT(victim->pinned);
+	if (victim->pc != NULL)
+	{
+		/* Someone looked it up meanwhile: keep it. */
+		if (!vm_cache_evict(victim, false))
+		{
+			lock_acquire(&frame_lock);
+			lru_add(victim, LRU_ACTIVE);
+			lock_release(&frame_lock);
+		}
+		vm_unpin_frame(victim);
+		return;
+	}
+	if (!swap_out(victim->page))
+		PANIC("vm_page_out: swap_out failed");
+	ASSERT(victim->page == NULL);
+	vm_unpin_frame(victim);
+}
+
+/* Pins FRAME, which may already be pinned.  Must be called with
+ * FRAME_LOCK held. */
+static void
+vm_pin_frame(struct frame *frame)
+{
+	ASSERT(lock_held_by_current_thread(&frame_lock));
+	if (frame->pinned++ == 0)
+		pinned_cnt++;
+}
+
+/* Drops a pin on FRAME and wakes any thread waiting for it.  Once
+ * no pins are left, if it no longer backs a page, it becomes free. */
+static void
+vm_unpin_frame(struct frame *frame)
+{
+	lock_acquire(&frame_lock);
+	ASSERT(frame->pinned > 0);
+	if (--frame->pinned == 0)
+	{
+		pinned_cnt--;
+		if (frame->page == NULL && !frame->ksm && frame->pc == NULL)
+		{
+			list_push_back(&free_frames, &frame->free_elem);
+			free_frame_cnt++;
+		}
+	}
+	cond_broadcast(&unpin_cond, &frame_lock);
+	lock_release(&frame_lock);
+}
+
+/* Waits, with FRAME_LOCK held, until PAGE's frame, if any, is not
+ * pinned.  A page that was being paged out is no longer resident
+ * afterward. */
+static void
+vm_wait_unpinned(struct page *page)
+{
+	ASSERT(lock_held_by_current_thread(&frame_lock));
+	while (page->frame != NULL && page->frame->pinned)
+		cond_wait(&unpin_cond, &frame_lock);
+}
+
+/* Breaks the link between PAGE and its frame.  The frame goes to
+ * the free list unless it is pinned, in which case vm_unpin_frame()
+ * frees it later.  A page cache frame instead loses a mapper, and
+ * once it has none left, is written back if need be and dropped;
+ * PAGE must be unmapped already. */
+void vm_frame_detach(struct page *page)
+{
+	struct frame *frame = page->frame;
+	bool locked = lock_held_by_current_thread(&frame_lock);
+	bool unmapped = false;
+
+	if (!locked)
+		lock_acquire(&frame_lock);
+	page->frame = NULL;
+	if (frame->pc != NULL)
+	{
+		uint64_t *pml4 = page_pml4(page);
+
+		list_remove(&page->file.pc_elem);
+		if (pml4_is_dirty(pml4, page->va))
+		{
+			frame->pc->dirty = true;
+			pml4_set_dirty(pml4, page->va, false);
+		}
+		unmapped = list_empty(&frame->pc->mappers);
+	}
+	else if (frame->ksm)
+		ksm_put(frame);
+	else
+	{
+		lru_del(frame);
+		frame->page = NULL;
+		if (!frame->pinned)
+		{
+			list_push_back(&free_frames, &frame->free_elem);
+			free_frame_cnt++;
+		}
+	}
+	if (!locked)
+		lock_release(&frame_lock);
+	if (unmapped && !locked)
+		vm_cache_evict(frame, true);
+}
+
+/* Evicts page cache FRAME: unmaps it from every page mapping it,
+ * writes it back if any of them dirtied it, and drops it from the
+ * cache.  If ONLY_UNMAPPED, does so only if nothing maps or pins
+ * it.  Afterward FRAME is free, or freed by vm_unpin_frame() if it
+ * is pinned.  Returns false, doing nothing, if the cache entry is
+ * in use. */
+static bool
+vm_cache_evict(struct frame *frame, bool only_unmapped)
+{
+	struct cached_page *cp = frame->pc;
+	bool dirty;
+
+	if (!page_cache_evict_begin(cp))
+		return false;
+
+	lock_acquire(&frame_lock);
+	if (only_unmapped && (!list_empty(&cp->mappers) || frame->pinned))
+	{
+		lock_release(&frame_lock);
+		page_cache_evict_end(cp, false);
+		return false;
+	}
+	while (!list_empty(&cp->mappers))
+	{
+		struct page *p = list_entry(list_pop_front(&cp->mappers),
+									struct page, file.pc_elem);
+		uint64_t *pml4 = page_pml4(p);
+
+		if (pml4_is_dirty(pml4, p->va))
+			cp->dirty = true;
+		pml4_clear_page(pml4, p->va);
+		p->frame = NULL;
+	}
+	lru_del(frame);
+	dirty = cp->dirty;
+	lock_release(&frame_lock);
+
+	/* Nothing can reach the frame now but this thread. */
+	if (dirty)
+		page_cache_write_back(cp);
+
+	lock_acquire(&frame_lock);
+	if (frame->writeback)
+	{
+		list_remove(&frame->wb_elem);
+		frame->writeback = false;
+	}
+	frame->pc = NULL;
+	if (!frame->pinned)
+	{
+		list_push_back(&free_frames, &frame->free_elem);
+		free_frame_cnt++;
+	}
+	lock_release(&frame_lock);
+	page_cache_evict_end(cp, true);
+	return true;
+}
+
+/* Returns the number of user frames that can be handed out without
+ * evicting anything. */
+static size_t
+vm_free_frames(void)
+{
+	return free_frame_cnt + palloc_free_cnt(PAL_USER);
+}
+
+/* Background page-out thread. */
+static void
+kswapd(void *aux UNUSED)
+{
+	for (;;)
+	{
+		sema_down(&kswapd_sema);
+
+		lock_acquire(&frame_lock);
+		while (vm_free_frames() < high_wmark)
+		{
+			struct frame *victim = vm_get_victim();
+			if (victim == NULL)
+				break;
+			lock_release(&frame_lock);
+			vm_page_out(victim);
+			kswapd_evict_cnt++;
+			lock_acquire(&frame_lock);
+		}
+		kswapd_awake = false;
+		lock_release(&frame_lock);
+	}
+}
+
+/* Moves the dirty bits of the pages mapping page cache FRAME into
+ * its entry and returns whether it is dirty.  Must be called with
+ * FRAME_LOCK held. */
+static bool
+cache_take_dirty(struct frame *frame)
+{
+	struct cached_page *cp = frame->pc;
+	struct list *mappers = &cp->mappers;
+
+	for (struct list_elem *e = list_begin(mappers);
+		 e != list_end(mappers); e = list_next(e))
+	{
+		struct page *p = list_entry(e, struct page, file.pc_elem);
+		if (pml4_is_dirty(page_pml4(p), p->va))
+		{
+			cp->dirty = true;
+			pml4_set_dirty(page_pml4(p), p->va, false);
+		}
+	}
+	return cp->dirty;
+}
+
+/* Returns whether any page maps page cache entry CP writable.
+ * Must be called with FRAME_LOCK held. */
+static bool
+cache_mapped_writable(struct cached_page *cp)
+{
+	for (struct list_elem *e = list_begin(&cp->mappers);
+		 e != list_end(&cp->mappers); e = list_next(e))
+		if (list_entry(e, struct page, file.pc_elem)->writable)
+			return true;
+	return false;
+}
+
+/* Adds page cache FRAME to BATCH, which holds *CNT entries, if it
+ * is dirty and not being evicted, holding it and marking it clean.
+ * Must be called with FRAME_LOCK held. */
+static void
+writeback_add(struct frame *frame, struct cached_page **batch, size_t *cnt)
+{
+	if (!cache_take_dirty(frame) || !page_cache_hold(frame->pc))
+		return;
+	frame->pc->dirty = false;
+	batch[(*cnt)++] = frame->pc;
+}
+
+/* Orders cached pages by file, then by offset. */
+static int
+writeback_cmp(const void *a_, const void *b_)
+{
+	const struct cached_page *a = *(struct cached_page *const *)a_;
+	const struct cached_page *b = *(struct cached_page *const *)b_;
+
+	if (a->inode != b->inode)
+		return (uintptr_t)a->inode < (uintptr_t)b->inode ? -1 : 1;
+	return a->ofs < b->ofs ? -1 : a->ofs > b->ofs;
+}
+
+/* Writes back the CNT entries of BATCH in file order and releases
+ * them.  Must be called without FRAME_LOCK. */
+static void
+writeback_batch(struct cached_page **batch, size_t cnt)
+{
+	qsort(batch, cnt, sizeof *batch, writeback_cmp);
+	for (size_t i = 0; i < cnt; i++)
+	{
+		page_cache_sync(batch[i]);
+		page_cache_put(batch[i]);
+	}
+}
+
+/* Background write-back thread.  A round that fills its batch is
+ * followed by another, but pages dirtied again as fast as they are
+ * written wait for the next pass after WRITEBACK_ROUNDS.  Frames
+ * found clean with no writable mapping leave the write-back list.
+ * The list is only peeked at without the lock; a frame added just
+ * after waits for the next pass. */
+static void
+flushd(void *aux UNUSED)
+{
+	struct cached_page *batch[WRITEBACK_BATCH];
+
+	for (;;)
+	{
+		size_t cnt = WRITEBACK_BATCH;
+
+		timer_sleep(WRITEBACK_INTERVAL);
+		if (list_empty(&writeback_frames))
+			continue;
+		for (int round = 0; round < WRITEBACK_ROUNDS &&
+							cnt == WRITEBACK_BATCH; round++)
+		{
+			cnt = 0;
+			lock_acquire(&frame_lock);
+			for (struct list_elem *e = list_begin(&writeback_frames);
+				 e != list_end(&writeback_frames) && cnt < WRITEBACK_BATCH;)
+			{
+				struct frame *f = list_entry(e, struct frame, wb_elem);
+				e = list_next(e);
+				writeback_add(f, batch, &cnt);
+				if (!f->pc->dirty && !cache_mapped_writable(f->pc))
+				{
+					list_remove(&f->wb_elem);
+					f->writeback = false;
+				}
+			}
+			lock_release(&frame_lock);
+			writeback_batch(batch, cnt);
+			flushd_page_cnt += cnt;
+		}
+		flushd_pass_cnt++;
+	}
+}
+
 /* palloc() and get frame. If there is no available page, evict the page
  * and return it. This always return valid address. That is, if the user pool
  * memory is full, this function evicts the frame to get the available memory
- * space.*/
+ * space.  The frame is returned pinned; the caller unpins it once the
+ * page is loaded. */
 static struct frame *
 vm_get_frame(void)
 {
 	struct frame *frame = NULL;
+	struct thread *t = thread_current();
 	lock_acquire(&frame_lock);
 
-	/* First, reuse a free frame if possible. */
-	for (struct list_elem *e = list_begin(&frame_table);
-		e != list_end(&frame_table); e = list_next(e))
+	/* A process at its resident-set limit replaces its own pages
+	 * rather than taking frames from everyone else. */
+	while (t->rss_limit > 0 && t->rss >= t->rss_limit)
 	{
-		struct frame *f = list_entry(e, struct frame, elem);
-		if (f->page == NULL)
-		{
-			frame = f;
+		struct frame *victim = vm_get_local_victim(t);
+		if (victim == NULL)
 			break;
-		}
+		lock_release(&frame_lock);
+		vm_page_out(victim);
+		local_evict_cnt++;
+		lock_acquire(&frame_lock);
 	}
 
-	if (frame == NULL)
+	while (frame == NULL)
 	{
+		/* First, reuse a free frame if possible. */
+		if (!list_empty(&free_frames))
+		{
+			frame = list_entry(list_pop_front(&free_frames),
+							   struct frame, free_elem);
+			free_frame_cnt--;
+			break;
+		}
+
 		void *kva = palloc_get_page(PAL_USER);
 		if (kva != NULL)
 		{
-			frame = malloc(sizeof *frame);
+			frame = malloc_tagged(sizeof *frame, MEM_FRAME);
 			if (frame == NULL)
 			{
 				palloc_free_page(kva);
 				PANIC("vm_get_frame: frame allocation failed");
 			}
+			malloc_disown(frame);
 			frame->kva = kva;
 			frame->page = NULL;
+			frame->huge = false;
+			frame->pinned = 0;
+			frame->ksm = false;
+			frame->pc = NULL;
+			frame->writeback = false;
+			frame->rss_owner = NULL;
+			frame->lru = LRU_NONE;
 			list_push_back(&frame_table, &frame->elem);
+			break;
 		}
-		else
+
+		/* kswapd has fallen behind: evict a page ourselves, or
+		 * wait for a page-out already under way. */
+		struct frame *victim = vm_get_victim();
+		if (victim != NULL)
 		{
-			frame = vm_evict_frame();
-			if (frame == NULL)
-				PANIC("vm_get_frame: cannot evict frame");
+			lock_release(&frame_lock);
+			vm_page_out(victim);
+			direct_evict_cnt++;
+			lock_acquire(&frame_lock);
 		}
+		else if (pinned_cnt > 0)
+			cond_wait(&unpin_cond, &frame_lock);
+		else
+			PANIC("vm_get_frame: cannot evict frame");
 	}
 
+	vm_pin_frame(frame);
+	frame->ksm_sum = 0;
+	if (!kswapd_awake && vm_free_frames() < low_wmark)
+	{
+		kswapd_awake = true;
+		kswapd_wake_cnt++;
+		sema_up(&kswapd_sema);
+	}
 	lock_release(&frame_lock);
 
 	ASSERT(frame != NULL);
@@ -295,17 +1123,624 @@ vm_stack_growth(void *addr UNUSED)
 
 /* Handle the fault on write_protected page */
 static bool
-vm_handle_wp(struct page *page UNUSED)
+vm_handle_wp(struct page *page)
 {
-	return false;
+	if (!page->writable)
+		return false;
+
+	/* Give the page a frame of its own. */
+	if (page->zero)
+	{
+		pml4_clear_page(page->owner->pml4, page->va);
+		page->zero = false;
+		zero_cow_cnt++;
+		return vm_do_claim_page(page);
+	}
+	if (page->frame == NULL)
+		return vm_do_claim_page(page);
+	return vm_ksm_unshare(page);
 }
 
-/* Return true on success */
-bool vm_try_handle_fault(struct intr_frame *f UNUSED, void *addr UNUSED,
-						 bool user UNUSED, bool write UNUSED, bool not_present UNUSED)
+/* Maps PAGE to the shared zero frame if it is an anonymous page
+ * that has not been loaded and would be all zeros when it is. */
+static bool
+vm_map_zero(struct page *page)
 {
-	struct supplemental_page_table *spt UNUSED = &thread_current()->spt;
-	struct page *page = NULL;
+	struct segment_aux *aux = page->uninit.aux;
+
+	if (VM_TYPE(page->operations->type) != VM_UNINIT ||
+		VM_TYPE(page->uninit.type) != VM_ANON ||
+		(aux != NULL && aux->read_bytes != 0))
+		return false;
+	if (!pml4_set_page(page->owner->pml4, page->va, zero_kva, false))
+		return false;
+	page->zero = true;
+	zero_map_cnt++;
+	return true;
+}
+
+/* Makes sure the page at VA in the running process is backed by a
+ * frame of its own that may be written, replacing a shared
+ * read-only mapping if need be.  Returns false if there is no
+ * writable page at VA. */
+bool vm_make_writable(void *va)
+{
+	struct page *page = spt_find_page(&thread_current()->spt, va);
+
+	if (page == NULL || !page->writable)
+		return false;
+	if (page->zero || (page->frame != NULL && page->frame->ksm))
+		return vm_handle_wp(page);
+	return true;
+}
+
+/* Returns true if PAGE may be loaded by fault-around: a page of a
+ * file-backed region that has not been loaded yet. */
+static bool
+fault_around_ok(struct page *page)
+{
+	return page != NULL && VM_TYPE(page->operations->type) == VM_UNINIT &&
+		   page->frame == NULL && !page->zero && page->uninit.aux != NULL;
+}
+
+/* Returns the end of the part of VMA that has file data. */
+static uint8_t *
+vma_data_end(const struct vma *vma)
+{
+	return (uint8_t *)vma->start + ROUND_UP(vma->read_bytes, PGSIZE);
+}
+
+/* Loads and maps the pages of file-backed region VMA in [LO, HI)
+ * that have not been loaded yet, reading the file for all of them
+ * at once.  The page at LO must be one of them, and HI must not be
+ * past vma_data_end().  If TARGET is one of the pages, stores in
+ * *SUCCESS whether it was loaded.  Adds the number of other pages
+ * loaded to *CNT.  Returns false, having loaded nothing, if the
+ * file cannot be read. */
+static bool
+vm_load_batch(struct vma *vma, uint8_t *lo, uint8_t *hi,
+			  struct page *target, bool *success, unsigned long long *cnt)
+{
+	struct supplemental_page_table *spt = &thread_current()->spt;
+	size_t ofs, bytes, n;
+	uint8_t *buf;
+	bool ok;
+
+	/* No need to read pages at the end that are loaded already. */
+	while (hi - PGSIZE > lo)
+	{
+		struct page *p = spt_lookup_page(spt, hi - PGSIZE);
+		if (p == NULL || fault_around_ok(p))
+			break;
+		hi -= PGSIZE;
+	}
+
+	n = (hi - lo) / PGSIZE;
+	buf = palloc_get_multiple(0, n);
+	if (buf == NULL)
+		return false;
+	ofs = lo - (uint8_t *)vma->start;
+	bytes = vma->read_bytes - ofs < n * PGSIZE ? vma->read_bytes - ofs
+											   : n * PGSIZE;
+	lock_acquire(&filesys_lock);
+	ok = file_read_at(vma->file, buf, bytes, vma->ofs + ofs) == (off_t)bytes;
+	lock_release(&filesys_lock);
+	if (!ok)
+	{
+		palloc_free_multiple(buf, n);
+		return false;
+	}
+
+	for (uint8_t *p = lo; p < hi; p += PGSIZE)
+	{
+		struct page *pg = target != NULL && p == (uint8_t *)target->va
+							  ? target
+							  : spt_find_page(spt, p);
+		struct segment_aux *aux;
+
+		if (!fault_around_ok(pg))
+			continue;
+		aux = pg->uninit.aux;
+		aux->data = buf + (p - lo);
+		ok = vm_do_claim_page(pg);
+		if (VM_TYPE(pg->operations->type) == VM_UNINIT)
+			aux->data = NULL;
+		if (pg == target)
+			*success = ok;
+		else if (ok)
+			(*cnt)++;
+	}
+	palloc_free_multiple(buf, n);
+	return true;
+}
+
+/* Loads PAGE, which is in a file-backed region, together with the
+ * neighbouring pages of the region that have not been loaded yet.
+ * Returns false if there is nothing to gain, in which case the
+ * caller loads PAGE alone; otherwise returns true and stores in
+ * *SUCCESS whether PAGE itself was loaded. */
+static bool
+vm_fault_around(struct page *page, bool *success)
+{
+	struct supplemental_page_table *spt = &thread_current()->spt;
+	struct vma *vma = vma_find(spt, page->va);
+	uint8_t *va = page->va, *lo, *hi;
+	size_t n;
+
+	if (vma == NULL || vma->file == NULL || vma->init == NULL ||
+		vma->advice == MADV_RANDOM || !fault_around_ok(page) ||
+		((struct segment_aux *)page->uninit.aux)->read_bytes == 0)
+		return false;
+
+	/* Grow the window while faults land right after the previous
+	 * one, as in a sequential scan, and shrink it otherwise. */
+	if (vma->ra_pages == 0)
+		vma->ra_pages = FAULT_AROUND_INIT;
+	if (vma->advice == MADV_SEQUENTIAL)
+	{
+		vma->ra_pages = FAULT_AROUND_MAX;
+		lo = va;
+	}
+	else if (va == vma->ra_next)
+	{
+		if (vma->ra_pages < FAULT_AROUND_MAX)
+			vma->ra_pages *= 2;
+		lo = va;
+	}
+	else
+	{
+		if (vma->ra_next != NULL && vma->ra_pages > 1)
+			vma->ra_pages /= 2;
+		lo = (uint8_t *)((uint64_t)va & ~(vma->ra_pages * PGSIZE - 1));
+	}
+	if (lo < (uint8_t *)vma->start)
+		lo = vma->start;
+	hi = lo + vma->ra_pages * PGSIZE;
+	if (hi > vma_data_end(vma))
+		hi = vma_data_end(vma);
+	vma->ra_next = hi;
+
+	/* Start at the first page that needs loading.  Not worth it for
+	 * one page, nor under memory pressure. */
+	while (lo < va)
+	{
+		struct page *p = spt_lookup_page(spt, lo);
+		if (p == NULL || fault_around_ok(p))
+			break;
+		lo += PGSIZE;
+	}
+	n = (hi - lo) / PGSIZE;
+	if (n <= 1 || vm_free_frames() < low_wmark + n)
+		return false;
+
+	*success = false;
+	if (!vm_load_batch(vma, lo, hi, page, success, &fault_around_pages))
+		return false;
+	fault_around_cnt++;
+	return true;
+}
+
+/* Moves FRAME to the back of the inactive list, to be evicted
+ * before any other frame.  Must be called with FRAME_LOCK held. */
+static void
+lru_deactivate(struct frame *frame)
+{
+	lru_del(frame);
+	frame->lru = LRU_INACTIVE;
+	list_push_back(&inactive_list, &frame->lru_elem);
+	inactive_cnt++;
+}
+
+/* Applies ADVICE, one of the MADV_* values, to the LENGTH bytes at
+ * ADDR in the running process.  Access-pattern advice is recorded
+ * in every region the range touches.  Returns false if the range
+ * or the advice is invalid. */
+bool vm_madvise(void *addr, size_t length, int advice)
+{
+	struct supplemental_page_table *spt = &thread_current()->spt;
+	uint8_t *start = addr, *end, *va;
+
+	if (pg_ofs(addr) != 0 || length == 0 ||
+		(uint64_t)start + length < (uint64_t)start ||
+		!is_user_vaddr(start) || !is_user_vaddr(start + length - 1))
+		return false;
+	end = (uint8_t *)ROUND_UP((uint64_t)start + length, PGSIZE);
+
+	switch (advice)
+	{
+	case MADV_NORMAL:
+	case MADV_RANDOM:
+	case MADV_SEQUENTIAL:
+		for (struct vma *vma = vma_overlap(spt, start, end);
+			 vma != NULL && (uint8_t *)vma->start < end;
+			 vma = vma_next(spt, vma->end))
+		{
+			vma->advice = advice;
+			vma->ra_pages = 0;
+			vma->ra_next = NULL;
+		}
+		break;
+
+	case MADV_WILLNEED:
+		/* Done right away: only the owner may add pages to its
+		 * table.  Stop short of pushing other pages out. */
+		for (va = start; va < end && vm_free_frames() >= high_wmark;
+			 va += PGSIZE)
+		{
+			struct page *page = spt_lookup_page(spt, va);
+			struct vma *vma;
+			uint8_t *hi;
+
+			if (page != NULL && !fault_around_ok(page))
+			{
+				/* Paged out since it was loaded. */
+				if (page->frame == NULL && !page->zero &&
+					VM_TYPE(page->operations->type) != VM_UNINIT &&
+					vm_do_claim_page(page))
+					madv_willneed_cnt++;
+				continue;
+			}
+			vma = vma_find(spt, va);
+			if (vma == NULL || vma->file == NULL || vma->init == NULL ||
+				va >= vma_data_end(vma))
+				continue;
+			hi = va + FAULT_AROUND_MAX * PGSIZE;
+			if (hi > end)
+				hi = end;
+			if (hi > vma_data_end(vma))
+				hi = vma_data_end(vma);
+			if (page == NULL && spt_find_page(spt, va) == NULL)
+				break;
+			if (!vm_load_batch(vma, va, hi, NULL, NULL, &madv_willneed_cnt))
+				break;
+			va = hi - PGSIZE;
+		}
+		break;
+
+	case MADV_DONTNEED:
+		/* Pages of a region come back from its file, or as zeros;
+		 * others are replaced by fresh zero pages. */
+		for (va = start; va < end; va += PGSIZE)
+		{
+			struct page *page = spt_lookup_page(spt, va);
+			bool writable;
+
+			if (page == NULL)
+				continue;
+			writable = page->writable;
+			spt_remove_page(spt, page);
+			madv_dontneed_cnt++;
+			if (vma_find(spt, va) == NULL &&
+				!vm_alloc_page(VM_ANON, va, writable))
+				return false;
+		}
+		break;
+
+	case MADV_COLD:
+		lock_acquire(&frame_lock);
+		for (va = start; va < end; va += PGSIZE)
+		{
+			struct page *page = spt_lookup_page(spt, va);
+			struct frame *frame = page != NULL ? page->frame : NULL;
+
+			if (frame == NULL || frame->ksm ||
+				(frame->page != page && frame->pc == NULL) ||
+				frame->lru == LRU_NONE)
+				continue;
+			pml4_set_accessed(thread_current()->pml4, va, false);
+			lru_deactivate(frame);
+			madv_cold_cnt++;
+		}
+		lock_release(&frame_lock);
+		break;
+
+	default:
+		return false;
+	}
+	return true;
+}
+
+/* Loads the pages of the running process in [START, END), which
+ * must be part of its regions, for MAP_POPULATE.  Pages with file
+ * data are read in runs of up to POPULATE_BATCH pages with one read
+ * per run, and the rest are claimed one at a time.  Stops early,
+ * leaving the rest to be faulted in, if memory or the file fails. */
+void vm_populate(void *start, void *end)
+{
+	struct supplemental_page_table *spt = &thread_current()->spt;
+
+	for (uint8_t *va = start; va < (uint8_t *)end; va += PGSIZE)
+	{
+		struct vma *vma = vma_find(spt, va);
+		struct page *page = spt_find_page(spt, va);
+
+		if (page == NULL)
+			break;
+		if (vma != NULL && vma->file != NULL && vma->init != NULL &&
+			va < vma_data_end(vma) && fault_around_ok(page))
+		{
+			uint8_t *hi = va + POPULATE_BATCH * PGSIZE;
+			unsigned long long cnt = 0;
+
+			if (hi > (uint8_t *)end)
+				hi = end;
+			if (hi > vma_data_end(vma))
+				hi = vma_data_end(vma);
+			if (vm_load_batch(vma, va, hi, NULL, NULL, &cnt))
+			{
+				populate_cnt += cnt;
+				populate_batch_cnt += cnt;
+				va = hi - PGSIZE;
+				continue;
+			}
+		}
+		if (page->frame == NULL)
+		{
+			if (!vm_do_claim_page(page))
+				break;
+			populate_cnt++;
+		}
+	}
+}
+
+/* Moves the break of the running process, the end of its heap, to
+ * ADDR.  The heap is an anonymous region from the end of the
+ * program image up to the page holding the last byte before the
+ * break; it grows and shrinks with the break, and its pages are
+ * created as they are touched.  Returns false, leaving the break
+ * alone, if ADDR is below the start of the heap or the heap would
+ * run into another region or the stack. */
+bool vm_brk(void *addr)
+{
+	struct thread *t = thread_current();
+	struct supplemental_page_table *spt = &t->spt;
+	uint8_t *brk = addr;
+	uint8_t *old_end = (uint8_t *)ROUND_UP((uint64_t)spt->brk, PGSIZE);
+	uint8_t *new_end = (uint8_t *)ROUND_UP((uint64_t)brk, PGSIZE);
+	struct vma *heap = old_end > spt->heap_start
+						   ? vma_find(spt, spt->heap_start)
+						   : NULL;
+
+	if (spt->heap_start == NULL || brk < spt->heap_start ||
+		new_end > (uint8_t *)USER_STACK - (1 << 20))
+		return false;
+
+	if (new_end > old_end)
+	{
+		if (vma_overlap(spt, old_end, new_end) != NULL)
+			return false;
+		if (heap != NULL)
+			heap->end = new_end;
+		else
+		{
+			struct vma v = {
+				.start = spt->heap_start,
+				.end = new_end,
+				.type = VM_ANON,
+				.writable = true,
+			};
+			if (vma_add(spt, &v) == NULL)
+				return false;
+		}
+	}
+	else if (new_end < old_end)
+	{
+		/* Page by page: a huge page may straddle NEW_END, and
+		 * destroying its pages splits it first. */
+		ASSERT(heap != NULL);
+		for (uint8_t *va = new_end; va < old_end; va += PGSIZE)
+		{
+			struct page *page = spt_lookup_page(spt, va);
+			if (page != NULL)
+				spt_remove_page(spt, page);
+		}
+		pml4_unmap_range(t->pml4, new_end, old_end);
+		if (new_end == spt->heap_start)
+			vma_destroy(spt, heap);
+		else
+			heap->end = new_end;
+	}
+	spt->brk = brk;
+	return true;
+}
+
+/* Moves the break of the running process by INCREMENT bytes, as
+ * vm_brk() does.  Returns the previous break, or (void *) -1 if the
+ * break cannot be moved. */
+void *vm_sbrk(intptr_t increment)
+{
+	uint8_t *old = thread_current()->spt.brk;
+
+	if (old == NULL ||
+		(increment > 0 && (uint64_t)old + increment < (uint64_t)old) ||
+		(increment < 0 && (uint64_t)-increment > (uint64_t)old) ||
+		!vm_brk(old + increment))
+		return (void *)-1;
+	return old;
+}
+
+/* Sets the resident-set limit of the running process to PAGES,
+ * or removes it if PAGES is 0.  A process above its new limit is
+ * brought under it by its later faults.  Returns the previous
+ * limit, or -1 if PAGES is below VM_RSS_LIMIT_MIN. */
+long vm_set_rss_limit(size_t pages)
+{
+	struct thread *t = thread_current();
+	size_t old = t->rss_limit;
+
+	if (pages != 0 && pages < VM_RSS_LIMIT_MIN)
+		return -1;
+	t->rss_limit = pages;
+	return old;
+}
+
+/* Writes back the page cache pages in [START, END) of SPT that
+ * its mappings have dirtied, in file order, and returns how many
+ * were written.  Must be called by SPT's owner. */
+static size_t
+vm_writeback_range(struct supplemental_page_table *spt,
+				   uint8_t *start, uint8_t *end)
+{
+	struct cached_page *batch[WRITEBACK_BATCH];
+	size_t cnt = 0, total = 0;
+
+	lock_acquire(&frame_lock);
+	for (uint8_t *va = start; va < end; va += PGSIZE)
+	{
+		struct page *page = spt_lookup_page(spt, va);
+
+		if (page == NULL || page->frame == NULL || page->frame->pc == NULL)
+			continue;
+		writeback_add(page->frame, batch, &cnt);
+		if (cnt == WRITEBACK_BATCH)
+		{
+			lock_release(&frame_lock);
+			writeback_batch(batch, cnt);
+			total += cnt;
+			cnt = 0;
+			lock_acquire(&frame_lock);
+		}
+	}
+	lock_release(&frame_lock);
+	writeback_batch(batch, cnt);
+	return total + cnt;
+}
+
+/* Writes the file pages in the LENGTH bytes at ADDR in the running
+ * process that it has modified back to their files: before
+ * returning if FLAGS has MS_SYNC, or else, with MS_ASYNC, at
+ * flushd's next pass.  MS_INVALIDATE is accepted and has no effect,
+ * since every mapping of a file page shares one frame with read()
+ * and write().  Returns false if the range or FLAGS is invalid or
+ * part of the range is not mapped. */
+bool vm_msync(void *addr, size_t length, int flags)
+{
+	struct supplemental_page_table *spt = &thread_current()->spt;
+	uint8_t *start = addr, *end, *va;
+
+	if (pg_ofs(addr) != 0 ||
+		(uint64_t)start + length < (uint64_t)start ||
+		!is_user_vaddr(start) || !is_user_vaddr(start + length - 1) ||
+		(flags & ~(MS_ASYNC | MS_INVALIDATE | MS_SYNC)) != 0 ||
+		(flags & (MS_ASYNC | MS_SYNC)) == (MS_ASYNC | MS_SYNC))
+		return false;
+	end = (uint8_t *)ROUND_UP((uint64_t)start + length, PGSIZE);
+
+	for (va = start; va < end; va += PGSIZE)
+		if (vma_find(spt, va) == NULL && spt_lookup_page(spt, va) == NULL)
+			return false;
+
+	if (flags & MS_SYNC)
+	{
+		msync_page_cnt += vm_writeback_range(spt, start, end);
+		return true;
+	}
+
+	lock_acquire(&frame_lock);
+	for (va = start; va < end; va += PGSIZE)
+	{
+		struct page *page = spt_lookup_page(spt, va);
+
+		if (page != NULL && page->frame != NULL && page->frame->pc != NULL)
+			cache_take_dirty(page->frame);
+	}
+	lock_release(&frame_lock);
+	return true;
+}
+
+/* Returns the kind of fault that loading PAGE, which is not
+ * resident, takes. */
+static enum vm_fault_kind
+fault_kind(struct page *page)
+{
+	struct file *file = NULL;
+	off_t ofs = 0;
+
+	switch (VM_TYPE(page->operations->type))
+	{
+	case VM_UNINIT:
+	{
+		struct segment_aux *aux = page->uninit.aux;
+		if (aux == NULL || aux->read_bytes == 0)
+			return VM_FAULT_MINOR;
+		if (VM_TYPE(page->uninit.type) != VM_FILE)
+			return VM_FAULT_FILE;
+		file = aux->file;
+		ofs = aux->ofs;
+		break;
+	}
+	case VM_FILE:
+		file = page->file.file;
+		ofs = page->file.ofs;
+		break;
+	default:
+		return VM_FAULT_SWAP;
+	}
+
+	/* Mapped file pages are found in memory if anyone maps them. */
+	if (file != NULL && page_cache_contains(file_get_inode(file), ofs))
+		return VM_FAULT_MINOR;
+	return VM_FAULT_FILE;
+}
+
+static bool vm_handle_fault(struct intr_frame *f, void *addr, bool user,
+							bool write, bool not_present,
+							enum vm_fault_kind *kind);
+
+/* Return true on success */
+bool vm_try_handle_fault(struct intr_frame *f UNUSED, void *addr UNUSED,
+						 bool user UNUSED, bool write UNUSED, bool not_present UNUSED)
+{
+	uint64_t start = rdtsc();
+	enum vm_fault_kind kind = VM_FAULT_MINOR;
+	struct vm_fault_stats *stats = &thread_current()->faults;
+	uint64_t cycles;
+	int bucket = 0;
+
+	if (!vm_handle_fault(f, addr, user, write, not_present, &kind))
+		return false;
+
+	cycles = rdtsc() - start;
+	while (cycles > 1 && bucket < VM_FAULT_HIST_CNT - 1)
+	{
+		cycles >>= 1;
+		bucket++;
+	}
+	stats->cnt[kind]++;
+	stats->hist[bucket]++;
+	return true;
+}
+
+/* Prints the page faults taken by the running process, if
+ * -pfstat is set. */
+void vm_print_faults(void)
+{
+	static const char *names[VM_FAULT_KIND_CNT] = {
+		"minor", "file", "swap", "stack", "cow"};
+	struct thread *t = thread_current();
+	struct vm_fault_stats *stats = &t->faults;
+
+	if (!vm_fault_report)
+		return;
+	printf("%s: page faults:", t->name);
+	for (int i = 0; i < VM_FAULT_KIND_CNT; i++)
+		printf(" %u %s%s", stats->cnt[i], names[i],
+			   i < VM_FAULT_KIND_CNT - 1 ? "," : "\n");
+	printf("%s: fault cycles:", t->name);
+	for (int i = 0; i < VM_FAULT_HIST_CNT; i++)
+		if (stats->hist[i] > 0)
+			printf(" 2^%d:%u", i, stats->hist[i]);
+	printf("\n");
+}
+
+/* Handles a page fault for vm_try_handle_fault() and stores its
+ * kind in *KIND. */
+static bool
+vm_handle_fault(struct intr_frame *f, void *addr, bool user UNUSED,
+				bool write, bool not_present, enum vm_fault_kind *kind)
+{
+	struct supplemental_page_table *spt UNUSED = &thread_current()->spt;
+	struct page *page = NULL;
 	/* TODO: Validate the fault */
 	/* TODO: Your code goes here */
 
@@ -328,14 +1763,32 @@ bool vm_try_handle_fault(struct intr_frame *f UNUSED, void *addr UNUSED,
 		page = spt_find_page(spt, addr);
 		if (page == NULL)
 			return false;
+		*kind = VM_FAULT_STACK;
 	}
 	if (page == NULL)
 		return false;
 	if (write && !page->writable)
 		return false;
 	if (!not_present)
-		return false;
+	{
+		*kind = VM_FAULT_COW;
+		return write && vm_handle_wp(page);
+	}
+
+	/* Wait out a page-out of this page that is in progress. */
+	lock_acquire(&frame_lock);
+	vm_wait_unpinned(page);
+	lock_release(&frame_lock);
 
+	bool success;
+	if (*kind != VM_FAULT_STACK && page->frame == NULL)
+		*kind = fault_kind(page);
+	if (vm_claim_huge(page, &success))
+		return success;
+	if (!write && vm_map_zero(page))
+		return true;
+	if (vm_fault_around(page, &success))
+		return success;
 	return vm_do_claim_page(page);
 }
 
@@ -359,35 +1812,672 @@ bool vm_claim_page(void *va UNUSED)
 	return vm_do_claim_page(page);
 }
 
+/* Returns the kernel address of user address VA in the running
+ * process, loading its page if necessary and keeping it resident
+ * until vm_unpin_page().  For use by system calls that block while
+ * they access user memory through the kernel mapping.  If WRITE,
+ * the page is given a private frame first, since writes through
+ * the kernel mapping do not fault.  Returns NULL if there is no
+ * page at VA. */
+void *vm_pin_page(const void *va, bool write)
+{
+	struct page *page = spt_find_page(&thread_current()->spt, (void *)va);
+
+	if (page == NULL)
+		return NULL;
+	for (;;)
+	{
+		if (write && !vm_make_writable(page->va))
+			return NULL;
+		if (page->zero)
+			return (uint8_t *)zero_kva + pg_ofs(va);
+		if (!vm_claim_pinned(page))
+			return NULL;
+		/* ksmd may have merged it before it was pinned. */
+		if (!write || !page->frame->ksm)
+		{
+			/* Stores through the kernel mapping leave the user
+			 * PTE clean; a file page must still be written back. */
+			if (write)
+				pml4_set_dirty(thread_current()->pml4, page->va, true);
+			return (uint8_t *)page_kva(page) + pg_ofs(va);
+		}
+		vm_unpin_frame(page->frame);
+	}
+}
+
+/* Releases a page pinned by vm_pin_page(). */
+void vm_unpin_page(const void *va)
+{
+	struct page *page = spt_find_page(&thread_current()->spt, (void *)va);
+
+	if (page != NULL && page->frame != NULL)
+		vm_unpin_frame(page->frame);
+}
+
 /* Claim the PAGE and set up the mmu. */
 static bool
 vm_do_claim_page(struct page *page)
 {
-	struct frame *frame = vm_get_frame();
-	bool success;
+	if (!vm_claim_pinned(page))
+		return false;
+	vm_unpin_frame(page->frame);
+	return true;
+}
+
+/* Like vm_do_claim_page(), but on success leaves PAGE's frame
+ * pinned so that it stays resident until the caller unpins it. */
+static bool
+vm_claim_pinned(struct page *page)
+{
+	struct frame *frame;
+
+	lock_acquire(&frame_lock);
+	vm_wait_unpinned(page);
+	frame = page->frame;
+	if (frame != NULL)
+	{
+		/* Already resident. */
+		vm_pin_frame(frame);
+	}
+	lock_release(&frame_lock);
+	if (frame != NULL)
+		return true;
+	if (page_get_type(page) == VM_FILE)
+		return vm_claim_shared(page);
+
+	frame = vm_get_frame();
 
 	/* Set links */
+	lock_acquire(&frame_lock);
 	frame->page = page;
 	page->frame = frame;
+	if (page->evicted_at != 0)
+	{
+		/* Coming back: was it evicted from the working set? */
+		refault_cnt++;
+		if (evict_clock - page->evicted_at <= active_cnt + inactive_cnt)
+		{
+			refault_ws_cnt++;
+			lru_add(frame, LRU_ACTIVE);
+		}
+		page->evicted_at = 0;
+	}
+	if (frame->lru == LRU_NONE)
+		lru_add(frame, LRU_INACTIVE);
+	lock_release(&frame_lock);
 
 	/* TODO: Insert page table entry to map page's VA to frame's PA. */
-	success = pml4_set_page(thread_current()->pml4, page->va, frame->kva,
-							page->writable);
-	if (!success)
+	if (!pml4_set_page(thread_current()->pml4, page->va, frame->kva,
+					   page->writable))
+	{
+		vm_frame_detach(page);
+		vm_unpin_frame(frame);
+		return false;
+	}
+
+	if (!swap_in(page, frame->kva))
+	{
+		vm_unpin_frame(frame);
+		return false;
+	}
+	return true;
+}
+
+/* Maps file-backed PAGE, which is not resident, to the page cache
+ * frame holding its page of the file, loading that first if need
+ * be, and leaves the frame pinned like vm_claim_pinned().  Every
+ * mapping of the page shares the frame. */
+static bool
+vm_claim_shared(struct page *page)
+{
+	const void *data = NULL;
+	struct cached_page *cp;
+	struct frame *frame;
+
+	if (VM_TYPE(page->operations->type) == VM_UNINIT)
+	{
+		struct segment_aux *aux = page->uninit.aux;
+
+		/* Fault-around may have read it already. */
+		if (aux != NULL)
+			data = aux->data;
+		if (!swap_in(page, NULL))
+			return false;
+	}
+	if (page->file.file == NULL)
+		return false;
+
+	cp = page_cache_get(file_get_inode(page->file.file), page->file.ofs);
+	if (cp == NULL)
+		return false;
+	if (cp->frame == NULL)
+	{
+		frame = vm_get_frame();
+		if (!page_cache_fill(cp, frame,
+							 page->file.read_bytes == cp->bytes ? data : NULL))
+		{
+			vm_unpin_frame(frame);
+			return false;
+		}
+		lock_acquire(&frame_lock);
+		frame->pc = cp;
+		lru_add(frame, LRU_INACTIVE);
+	}
+	else
+	{
+		frame = cp->frame;
+		lock_acquire(&frame_lock);
+		vm_pin_frame(frame);
+	}
+	list_push_back(&cp->mappers, &page->file.pc_elem);
+	if (page->writable && !frame->writeback)
+	{
+		list_push_back(&writeback_frames, &frame->wb_elem);
+		frame->writeback = true;
+	}
+	page->frame = frame;
+	lock_release(&frame_lock);
+	page_cache_put(cp);
+
+	if (!pml4_set_page(page_pml4(page), page->va, frame->kva, page->writable))
+	{
+		vm_frame_detach(page);
+		vm_unpin_frame(frame);
+		return false;
+	}
+	return true;
+}
+
+/* Maps the whole 2 MB region around PAGE with a huge page if THP
+ * is enabled, the region lies in one writable anonymous region and
+ * past any file data in it (so a BSS qualifies but a data segment
+ * does not), and none of its pages has been loaded yet, so that
+ * nothing needs to be read or gathered from other frames or swap.
+ * Only pages that already exist are checked; the rest are created
+ * once the huge page is certain, so that a fault that ends up
+ * mapping PAGE alone creates no pages it will never touch.  Returns
+ * false if the region does not qualify, no aligned run of frames is
+ * free, or one of its pages cannot be initialized, in which case
+ * the caller maps PAGE alone.  Otherwise returns true and sets
+ * *SUCCESS. */
+static bool
+vm_claim_huge(struct page *page, bool *success)
+{
+	struct thread *t = thread_current();
+	uint8_t *base = (uint8_t *)((uint64_t)page->va & ~LARGE_PGMASK);
+	struct vma *vma;
+	struct frame *frame;
+	void *kva;
+
+	if (!vm_thp_enabled)
+		return false;
+	if (!is_user_vaddr(base) || !is_user_vaddr(base + LARGE_PGSIZE - 1))
+		return false;
+	vma = vma_find(&t->spt, base);
+	if (vma == NULL || (uint8_t *)vma->end < base + LARGE_PGSIZE ||
+		VM_TYPE(vma->type) != VM_ANON || !vma->writable ||
+		(vma->file != NULL && (uint8_t *)vma->start + vma->read_bytes > base))
+		return false;
+	for (size_t i = 0; i < HUGE_PAGE_CNT; i++)
+	{
+		struct page *p = spt_lookup_page(&t->spt, base + i * PGSIZE);
+		if (p != NULL &&
+			(!p->writable || p->frame != NULL || p->zero ||
+			 VM_TYPE(p->operations->type) != VM_UNINIT ||
+			 VM_TYPE(p->uninit.type) != VM_ANON))
+			return false;
+	}
+
+	kva = palloc_get_aligned(PAL_USER, HUGE_PAGE_CNT, LARGE_PGSIZE);
+	if (kva == NULL)
+	{
+		thp_fallback_cnt++;
+		return false;
+	}
+	frame = malloc_tagged(sizeof *frame, MEM_FRAME);
+	for (size_t i = 0; i < HUGE_PAGE_CNT && frame != NULL; i++)
+		if (spt_find_page(&t->spt, base + i * PGSIZE) == NULL)
+		{
+			free(frame);
+			frame = NULL;
+		}
+	if (frame == NULL)
+	{
+		palloc_free_multiple(kva, HUGE_PAGE_CNT);
+		return false;
+	}
+	if (!pml4_set_large_page(t->pml4, (uint64_t)base, vtop(kva),
+							 PTE_U | PTE_W))
 	{
-		palloc_free_page(frame->kva);
 		free(frame);
-		page->frame = NULL;
+		palloc_free_multiple(kva, HUGE_PAGE_CNT);
 		return false;
 	}
 
-	return swap_in(page, frame->kva);
+	malloc_disown(frame);
+	frame->kva = kva;
+	frame->page = spt_lookup_page(&t->spt, base);
+	frame->huge = true;
+	frame->pinned = 1;
+	frame->ksm = false;
+	frame->pc = NULL;
+	frame->writeback = false;
+	frame->rss_owner = NULL;
+	frame->lru = LRU_NONE;
+	lock_acquire(&frame_lock);
+	list_push_back(&frame_table, &frame->elem);
+	lru_add(frame, LRU_INACTIVE);
+	pinned_cnt++;
+	lock_release(&frame_lock);
+	thp_fault_cnt++;
+
+	size_t loaded;
+	for (loaded = 0; loaded < HUGE_PAGE_CNT; loaded++)
+	{
+		struct page *p = spt_lookup_page(&t->spt, base + loaded * PGSIZE);
+		p->frame = frame;
+		if (!swap_in(p, (uint8_t *)kva + loaded * PGSIZE))
+		{
+			p->frame = NULL;
+			break;
+		}
+	}
+	if (loaded < HUGE_PAGE_CNT)
+	{
+		vm_unclaim_huge(frame, loaded);
+		thp_fallback_cnt++;
+		return false;
+	}
+	vm_unpin_frame(frame);
+	*success = true;
+	return true;
+}
+
+/* Backs out of vm_claim_huge() after its pinned huge FRAME was
+ * filled for only its first LOADED pages.  Those keep 4 kB frames
+ * of their own; the rest of the region is unmapped and its memory
+ * freed, so that its pages fault in one at a time. */
+static void
+vm_unclaim_huge(struct frame *frame, size_t loaded)
+{
+	struct thread *t = thread_current();
+	uint8_t *base = frame->page->va;
+
+	lock_acquire(&frame_lock);
+	frame->pinned = 0;
+	pinned_cnt--;
+	if (loaded == 0)
+		vm_free_huge_frame(frame);
+	else
+	{
+		vm_split_huge_frame(frame);
+		pml4_clear_range(t->pml4, base + loaded * PGSIZE,
+						 base + LARGE_PGSIZE);
+	}
+	cond_broadcast(&unpin_cond, &frame_lock);
+	lock_release(&frame_lock);
+}
+
+/* Breaks huge FRAME back into 4 kB frames, remapping its pages
+ * with 4 kB PTEs.  FRAME keeps the first page; the others get new
+ * frames placed right after it in the frame table. */
+void vm_split_huge_frame(struct frame *frame)
+{
+	struct page *head = frame->page;
+	struct thread *owner = head->owner;
+	bool locked = lock_held_by_current_thread(&frame_lock);
+
+	ASSERT(frame->huge);
+
+	if (!locked)
+		lock_acquire(&frame_lock);
+	if (!pml4_split_large_page(owner->pml4, (uint64_t)head->va))
+		PANIC("vm_split_huge_frame: out of memory");
+
+	struct list_elem *pos = list_next(&frame->elem);
+	for (size_t i = 1; i < HUGE_PAGE_CNT; i++)
+	{
+		struct page *p = spt_lookup_page(&owner->spt,
+										 (uint8_t *)head->va + i * PGSIZE);
+		struct frame *f = malloc_tagged(sizeof *f, MEM_FRAME);
+		if (f == NULL)
+			PANIC("vm_split_huge_frame: frame allocation failed");
+		malloc_disown(f);
+		f->kva = (uint8_t *)frame->kva + i * PGSIZE;
+		f->page = (p != NULL && p->frame == frame) ? p : NULL;
+		f->huge = false;
+		f->pinned = 0;
+		f->ksm = false;
+		f->pc = NULL;
+		f->writeback = false;
+		f->rss_owner = NULL;
+		f->lru = LRU_NONE;
+		if (f->page != NULL)
+		{
+			p->frame = f;
+			lru_add(f, LRU_INACTIVE);
+		}
+		else
+		{
+			list_push_back(&free_frames, &f->free_elem);
+			free_frame_cnt++;
+		}
+		list_insert(pos, &f->elem);
+	}
+	if (frame->rss_owner != NULL)
+		frame->rss_owner->rss -= HUGE_PAGE_CNT - 1;
+	frame->huge = false;
+	thp_split_cnt++;
+
+	if (!locked)
+		lock_release(&frame_lock);
+}
+
+/* Releases huge FRAME and its memory without splitting it, for
+ * address-space teardown.  Must be called with FRAME_LOCK held. */
+static void
+vm_free_huge_frame(struct frame *frame)
+{
+	struct page *head = frame->page;
+	struct thread *owner = head->owner;
+
+	ASSERT(lock_held_by_current_thread(&frame_lock));
+	ASSERT(!frame->pinned);
+
+	for (size_t i = 0; i < HUGE_PAGE_CNT; i++)
+	{
+		struct page *p = spt_lookup_page(&owner->spt,
+										 (uint8_t *)head->va + i * PGSIZE);
+		if (p != NULL && p->frame == frame)
+			p->frame = NULL;
+	}
+	pml4_clear_page(owner->pml4, head->va);
+
+	lru_del(frame);
+	if (ksm_cursor == &frame->elem)
+		ksm_cursor = list_next(ksm_cursor);
+	list_remove(&frame->elem);
+
+	palloc_free_multiple(frame->kva, HUGE_PAGE_CNT);
+	free(frame);
+}
+
+/* Remaps PAGE, which is resident, to KVA with write access RW. */
+static void
+ksm_remap(struct page *page, void *kva, bool rw)
+{
+	uint64_t *pml4 = page->owner->pml4;
+
+	pml4_clear_page(pml4, page->va);
+	if (!pml4_set_page(pml4, page->va, kva, rw))
+		PANIC("ksm_remap: page table vanished");
+}
+
+/* Returns true if F backs a private anonymous page that ksmd may
+ * merge. */
+static bool
+ksm_eligible(const struct frame *f)
+{
+	return f->page != NULL && !f->pinned && !f->huge &&
+		   VM_TYPE(f->page->operations->type) == VM_ANON &&
+		   f->page->owner != NULL && f->page->owner->pml4 != NULL;
+}
+
+/* Moves the page in F, whose contents equal shared frame S and
+ * which is already mapped read-only, onto S and frees F. */
+static void
+ksm_merge(struct frame *f, struct frame *s)
+{
+	struct page *p = f->page;
+
+	ksm_remap(p, s->kva, false);
+	p->frame = s;
+	s->ksm_refs++;
+	ksm_sharing_cnt++;
+	ksm_merge_cnt++;
+
+	lru_del(f);
+	f->page = NULL;
+	list_push_back(&free_frames, &f->free_elem);
+	free_frame_cnt++;
+}
+
+/* Drops one reference to shared FRAME, which becomes free once
+ * unreferenced. */
+static void
+ksm_put(struct frame *frame)
+{
+	ASSERT(frame->ksm && frame->ksm_refs > 0);
+	ksm_sharing_cnt--;
+	if (--frame->ksm_refs > 0)
+		return;
+
+	hash_delete(&ksm_stable, &frame->ksm_elem);
+	frame->ksm = false;
+	ksm_shared_cnt--;
+	if (!frame->pinned)
+	{
+		list_push_back(&free_frames, &frame->free_elem);
+		free_frame_cnt++;
+	}
+}
+
+/* Scans the frame at KSM_CURSOR.  Must be called with FRAME_LOCK
+ * held.  Pages are mapped read-only before they are compared, so a
+ * write by their owner faults and waits for FRAME_LOCK, and then
+ * finds the page either merged or with its mapping restored. */
+static void
+ksm_scan_one(void)
+{
+	if (list_empty(&frame_table))
+		return;
+	if (ksm_cursor == NULL || ksm_cursor == list_end(&frame_table))
+	{
+		/* A new pass. */
+		ksm_cursor = list_begin(&frame_table);
+		memset(ksm_unstable, 0, sizeof ksm_unstable);
+	}
+
+	struct frame *f = list_entry(ksm_cursor, struct frame, elem);
+	ksm_cursor = list_next(ksm_cursor);
+	ksm_scan_cnt++;
+	if (!ksm_eligible(f))
+		return;
+
+	uint64_t sum = hash_bytes(f->kva, PGSIZE);
+	if (sum != f->ksm_sum)
+	{
+		/* Changed since the last pass: too volatile to share. */
+		f->ksm_sum = sum;
+		return;
+	}
+
+	struct frame key;
+	struct hash_elem *e;
+	key.ksm_sum = sum;
+	e = hash_find(&ksm_stable, &key.ksm_elem);
+	if (e != NULL)
+	{
+		struct frame *s = hash_entry(e, struct frame, ksm_elem);
+		ksm_remap(f->page, f->kva, false);
+		if (!memcmp(s->kva, f->kva, PGSIZE))
+			ksm_merge(f, s);
+		else
+			ksm_remap(f->page, f->kva, f->page->writable);
+		return;
+	}
+
+	struct frame **slot = &ksm_unstable[sum % KSM_UNSTABLE_CNT];
+	struct frame *g = *slot;
+	*slot = f;
+	if (g == NULL || g == f || !ksm_eligible(g) || g->ksm_sum != sum)
+		return;
+
+	ksm_remap(f->page, f->kva, false);
+	ksm_remap(g->page, g->kva, false);
+	if (memcmp(g->kva, f->kva, PGSIZE))
+	{
+		ksm_remap(f->page, f->kva, f->page->writable);
+		ksm_remap(g->page, g->kva, g->page->writable);
+		return;
+	}
+
+	/* G becomes the shared frame. */
+	*slot = NULL;
+	lru_del(g);
+	g->page = NULL;
+	g->ksm = true;
+	g->ksm_refs = 1;
+	hash_insert(&ksm_stable, &g->ksm_elem);
+	ksm_shared_cnt++;
+	ksm_sharing_cnt++;
+	ksm_merge(f, g);
+}
+
+/* Same-page merging thread. */
+static void
+ksmd(void *aux UNUSED)
+{
+	for (;;)
+	{
+		timer_sleep(KSM_INTERVAL);
+		for (size_t i = 0; i < vm_ksm_scan_rate; i++)
+		{
+			lock_acquire(&frame_lock);
+			ksm_scan_one();
+			lock_release(&frame_lock);
+		}
+	}
+}
+
+/* Handles a write fault on resident PAGE: gives it a private copy
+ * if it is merged, or restores write access that ksmd removed
+ * while comparing it. */
+static bool
+vm_ksm_unshare(struct page *page)
+{
+	struct frame *copy = NULL;
+
+	lock_acquire(&frame_lock);
+	while (page->frame != NULL && page->frame->ksm &&
+		   page->frame->ksm_refs > 1 && copy == NULL)
+	{
+		/* Allocating may evict, so drop the lock and look again. */
+		lock_release(&frame_lock);
+		copy = vm_get_frame();
+		lock_acquire(&frame_lock);
+	}
+
+	struct frame *s = page->frame;
+	if (s == NULL)
+	{
+		/* Paged out meanwhile. */
+		lock_release(&frame_lock);
+		if (copy != NULL)
+			vm_unpin_frame(copy);
+		return vm_do_claim_page(page);
+	}
+
+	if (s->ksm && s->ksm_refs == 1)
+	{
+		/* The last user takes the frame back. */
+		hash_delete(&ksm_stable, &s->ksm_elem);
+		s->ksm = false;
+		s->ksm_refs = 0;
+		s->page = page;
+		lru_add(s, LRU_ACTIVE);
+		ksm_shared_cnt--;
+		ksm_sharing_cnt--;
+		ksm_cow_cnt++;
+	}
+	else if (s->ksm)
+	{
+		memcpy(copy->kva, s->kva, PGSIZE);
+		copy->page = page;
+		page->frame = copy;
+		lru_add(copy, LRU_ACTIVE);
+		ksm_put(s);
+		ksm_cow_cnt++;
+	}
+	ksm_remap(page, page->frame->kva, true);
+	lock_release(&frame_lock);
+
+	if (copy != NULL)
+		vm_unpin_frame(copy);
+	return true;
+}
+
+static uint64_t
+ksm_hash(const struct hash_elem *e, void *aux UNUSED)
+{
+	return hash_entry(e, struct frame, ksm_elem)->ksm_sum;
+}
+
+static bool
+ksm_less(const struct hash_elem *a, const struct hash_elem *b,
+		 void *aux UNUSED)
+{
+	return hash_entry(a, struct frame, ksm_elem)->ksm_sum <
+		   hash_entry(b, struct frame, ksm_elem)->ksm_sum;
+}
+
+/* Prints virtual memory statistics. */
+void vm_print_stats(void)
+{
+	vm_anon_print_stats();
+	if (kswapd_evict_cnt > 0 || direct_evict_cnt > 0)
+		printf("Page-out: %llu pages by kswapd in %llu wakeups, "
+			   "%llu direct; watermarks %zu/%zu frames\n",
+			   kswapd_evict_cnt, kswapd_wake_cnt, direct_evict_cnt,
+			   low_wmark, high_wmark);
+	if (evict_clock > 0)
+		printf("LRU: %zu active, %zu inactive; %llu activated, "
+			   "%llu deactivated; evicted %llu clean, %llu dirty; "
+			   "%llu refaults, %llu in working set\n",
+			   active_cnt, inactive_cnt, activate_cnt, deactivate_cnt,
+			   evict_clean_cnt, evict_dirty_cnt, refault_cnt, refault_ws_cnt);
+	if (flushd_page_cnt + msync_page_cnt > 0)
+		printf("Write-back: %llu pages by flushd in %llu passes, "
+			   "%llu by msync\n",
+			   flushd_page_cnt, flushd_pass_cnt, msync_page_cnt);
+	if (populate_cnt > 0)
+		printf("MAP_POPULATE: %llu pages loaded, %llu by batched reads\n",
+			   populate_cnt, populate_batch_cnt);
+	if (local_evict_cnt > 0)
+		printf("RSS limits: %llu pages evicted by their own process\n",
+			   local_evict_cnt);
+	if (teardown_frame_cnt + teardown_slot_cnt + teardown_wb_cnt > 0)
+		printf("Teardown: %llu frames and %llu swap slots released in bulk, "
+			   "%llu pages written back\n",
+			   teardown_frame_cnt, teardown_slot_cnt, teardown_wb_cnt);
+	if (fault_around_cnt > 0)
+		printf("Fault-around: %llu batched reads, %llu extra pages mapped\n",
+			   fault_around_cnt, fault_around_pages);
+	if (madv_willneed_cnt + madv_dontneed_cnt + madv_cold_cnt > 0)
+		printf("madvise: %llu pages loaded, %llu dropped, %llu made cold\n",
+			   madv_willneed_cnt, madv_dontneed_cnt, madv_cold_cnt);
+	if (vm_ksm_scan_rate > 0)
+		printf("KSM: %zu frames shared by %zu pages (%zu saved), "
+			   "%llu scanned, %llu merged, %llu unshared on write\n",
+			   ksm_shared_cnt, ksm_sharing_cnt,
+			   ksm_sharing_cnt - ksm_shared_cnt,
+			   ksm_scan_cnt, ksm_merge_cnt, ksm_cow_cnt);
+	if (zero_map_cnt > 0)
+		printf("Zero page: %llu read faults mapped, %llu later written\n",
+			   zero_map_cnt, zero_cow_cnt);
+	if (vm_thp_enabled)
+		printf("THP: %llu huge page faults, %llu splits, %llu fallbacks\n",
+			   thp_fault_cnt, thp_split_cnt, thp_fallback_cnt);
+	page_cache_print_stats();
 }
 
 /* Initialize new supplemental page table */
 void supplemental_page_table_init(struct supplemental_page_table *spt UNUSED)
 {
 	hash_init(&spt->page_map, page_hash, page_less, NULL);
+	spt->vmas = NULL;
+	spt->heap_start = spt->brk = NULL;
 }
 
 /* Copy supplemental page table from src to dst */
@@ -396,6 +2486,11 @@ bool supplemental_page_table_copy(struct supplemental_page_table *dst UNUSED,
 {
 	struct hash_iterator it;
 
+	if (!vma_copy(dst, src))
+		return false;
+	dst->heap_start = src->heap_start;
+	dst->brk = src->brk;
+
 	hash_first(&it, &src->page_map);
 	while (hash_next(&it))
 	{
@@ -404,16 +2499,22 @@ bool supplemental_page_table_copy(struct supplemental_page_table *dst UNUSED,
 		enum vm_type type = page_get_type(src_page);
 		struct page *dst_page = NULL;
 
-		/* Memory-mapped file pages are not inherited. */
+		/* The child maps file pages from the page cache, sharing
+		 * them with the parent, as it touches them. */
 		if (type == VM_FILE)
 			continue;
 
+		/* The child creates untouched region pages itself. */
+		if (VM_TYPE(src_page->operations->type) == VM_UNINIT &&
+			vma_find(src, src_page->va) != NULL)
+			continue;
+
 		if (type == VM_UNINIT)
 		{
 			struct segment_aux *dst_aux = NULL;
 			if (src_page->uninit.aux != NULL)
 			{
-				dst_aux = malloc(sizeof *dst_aux);
+				dst_aux = malloc_tagged(sizeof *dst_aux, MEM_SPT);
 				if (dst_aux == NULL)
 					return false;
 				memcpy(dst_aux, src_page->uninit.aux, sizeof *dst_aux);
@@ -434,25 +2535,103 @@ bool supplemental_page_table_copy(struct supplemental_page_table *dst UNUSED,
 		if (!vm_alloc_page(type, src_page->va, src_page->writable))
 			return false;
 		dst_page = spt_find_page(dst, src_page->va);
-		if (dst_page == NULL || !vm_do_claim_page(dst_page))
+		if (dst_page == NULL || !vm_claim_pinned(dst_page))
 			return false;
 
-		if (src_page->frame != NULL)
-			memcpy(dst_page->frame->kva, src_page->frame->kva, PGSIZE);
+		/* The parent is waiting for us, so only kswapd can change
+		 * SRC_PAGE: keep it resident while copying, or read it
+		 * back from swap if it is already out. */
+		struct frame *src_frame;
+		lock_acquire(&frame_lock);
+		vm_wait_unpinned(src_page);
+		src_frame = src_page->frame;
+		if (src_frame != NULL)
+		{
+			vm_pin_frame(src_frame);
+		}
+		lock_release(&frame_lock);
+
+		bool ok = true;
+		if (src_frame != NULL)
+		{
+			memcpy(dst_page->frame->kva, page_kva(src_page), PGSIZE);
+			vm_unpin_frame(src_frame);
+		}
+		else if (type == VM_ANON)
+			ok = anon_read_swapped(src_page, dst_page->frame->kva);
+		vm_unpin_frame(dst_page->frame);
+		if (!ok)
+			return false;
 	}
 	return true;
 }
 
-/* Free the resource hold by the supplemental page table */
+/* Free the resource hold by the supplemental page table.  This is
+ * address-space teardown, so it works in bulk where it can: file
+ * mappings are written back in one sorted pass, the address space
+ * is unmapped with one TLB flush, private frames go back to the
+ * free list under one acquisition of FRAME_LOCK, and swap slots
+ * are freed under one acquisition of the swap lock.  What is left
+ * is torn down page by page. */
 void supplemental_page_table_kill(struct supplemental_page_table *spt UNUSED)
 {
+	struct thread *t = thread_current();
+	struct hash_iterator it;
+	struct vma *vma;
+
+	/* Write back what file mappings dirtied while the pages are
+	 * still mapped, so that dropping them below writes nothing. */
+	for (vma = vma_next(spt, NULL); vma != NULL; vma = vma_next(spt, vma->end))
+		if (VM_TYPE(vma->type) == VM_FILE && vma->writable)
+			teardown_wb_cnt += vm_writeback_range(spt, vma->start, vma->end);
+
+	/* From here on nothing runs in this address space.  Entries keep
+	 * their dirty bits for the page cache to collect. */
+	if (t->pml4 != NULL)
+		pml4_clear_range(t->pml4, NULL, (void *)KERN_BASE);
+
 	/* Unmap all memory-mapped files. */
-	while (!list_empty(&thread_current()->mmap_list))
+	vma = vma_next(spt, NULL);
+	while (vma != NULL)
 	{
-		struct mmap_region *mr = list_entry(list_front(&thread_current()->mmap_list),
-									struct mmap_region, elem);
-		do_munmap(mr->addr);
+		struct vma *next = vma_next(spt, vma->end);
+		if (VM_TYPE(vma->type) == VM_FILE)
+			do_munmap(vma->start);
+		vma = next;
+	}
+
+	/* Drop huge pages whole rather than splitting each one as its
+	 * first page is destroyed, and free private anonymous frames
+	 * here rather than one lock round trip per page.  Pinned frames
+	 * are being paged out and are left to their pages. */
+	lock_acquire(&frame_lock);
+	hash_first(&it, &spt->page_map);
+	while (hash_next(&it))
+	{
+		struct page *page = hash_entry(hash_cur(&it), struct page, spt_elem);
+		struct frame *frame = page->frame;
+
+		if (frame == NULL)
+			continue;
+		if (frame->huge)
+		{
+			if (frame->page == page)
+				vm_free_huge_frame(frame);
+			continue;
+		}
+		if (frame->pinned || frame->page != page || frame->ksm ||
+			VM_TYPE(page->operations->type) != VM_ANON)
+			continue;
+		page->frame = NULL;
+		lru_del(frame);
+		frame->page = NULL;
+		list_push_back(&free_frames, &frame->free_elem);
+		free_frame_cnt++;
+		teardown_frame_cnt++;
 	}
+	lock_release(&frame_lock);
+	teardown_slot_cnt += anon_release_swap(spt);
 
 	hash_destroy(&spt->page_map, spt_destroy_page);
+	vma_kill(spt);
 }
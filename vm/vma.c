@@ -0,0 +1,214 @@
+/* vma.c: Regions of an address space.
+
+   Each supplemental page table keeps its regions in an AVL tree
+   ordered by start address.  Regions never overlap, so ordering
+   by start also orders them by end, and the region containing an
+   address is the first one that ends past it. */
+
+#include "vm/vma.h"
+#include <debug.h>
+#include "filesys/file.h"
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/vaddr.h"
+#include "vm/vm.h"
+
+static inline int
+height (const struct vma *v) {
+	return v != NULL ? v->height : 0;
+}
+
+static void
+update (struct vma *v) {
+	int l = height (v->left), r = height (v->right);
+	v->height = (l > r ? l : r) + 1;
+}
+
+static struct vma *
+rotate_right (struct vma *v) {
+	struct vma *l = v->left;
+	v->left = l->right;
+	l->right = v;
+	update (v);
+	update (l);
+	return l;
+}
+
+static struct vma *
+rotate_left (struct vma *v) {
+	struct vma *r = v->right;
+	v->right = r->left;
+	r->left = v;
+	update (v);
+	update (r);
+	return r;
+}
+
+/* Restores the AVL property at V, whose subtrees are balanced and
+ * differ in height by at most 2.  Returns the new subtree root. */
+static struct vma *
+rebalance (struct vma *v) {
+	int balance = height (v->left) - height (v->right);
+
+	update (v);
+	if (balance > 1) {
+		if (height (v->left->left) < height (v->left->right))
+			v->left = rotate_left (v->left);
+		return rotate_right (v);
+	}
+	if (balance < -1) {
+		if (height (v->right->right) < height (v->right->left))
+			v->right = rotate_right (v->right);
+		return rotate_left (v);
+	}
+	return v;
+}
+
+static struct vma *
+tree_insert (struct vma *root, struct vma *v) {
+	if (root == NULL)
+		return v;
+	if (v->start < root->start)
+		root->left = tree_insert (root->left, v);
+	else
+		root->right = tree_insert (root->right, v);
+	return rebalance (root);
+}
+
+/* Unlinks the leftmost node of ROOT into *MIN. */
+static struct vma *
+tree_remove_min (struct vma *root, struct vma **min) {
+	if (root->left == NULL) {
+		*min = root;
+		return root->right;
+	}
+	root->left = tree_remove_min (root->left, min);
+	return rebalance (root);
+}
+
+static struct vma *
+tree_remove (struct vma *root, struct vma *v) {
+	ASSERT (root != NULL);
+
+	if (root == v) {
+		struct vma *succ, *right;
+
+		if (v->right == NULL)
+			return v->left;
+		right = tree_remove_min (v->right, &succ);
+		succ->left = v->left;
+		succ->right = right;
+		return rebalance (succ);
+	}
+	if (v->start < root->start)
+		root->left = tree_remove (root->left, v);
+	else
+		root->right = tree_remove (root->right, v);
+	return rebalance (root);
+}
+
+/* Returns the first region in SPT that ends after VA, that is,
+ * the region containing VA or else the next one above it. */
+struct vma *
+vma_next (struct supplemental_page_table *spt, const void *va) {
+	struct vma *best = NULL;
+
+	for (struct vma *v = spt->vmas; v != NULL; )
+		if ((const uint8_t *) v->end > (const uint8_t *) va) {
+			best = v;
+			v = v->left;
+		} else
+			v = v->right;
+	return best;
+}
+
+/* Returns the region of SPT containing VA, or NULL. */
+struct vma *
+vma_find (struct supplemental_page_table *spt, const void *va) {
+	struct vma *v = vma_next (spt, va);
+
+	return v != NULL && v->start <= va ? v : NULL;
+}
+
+/* Returns a region of SPT that overlaps [START, END), or NULL. */
+struct vma *
+vma_overlap (struct supplemental_page_table *spt,
+		const void *start, const void *end) {
+	struct vma *v = vma_next (spt, start);
+
+	return v != NULL && v->start < end ? v : NULL;
+}
+
+/* Returns true if V stores into its file through the page cache,
+ * which write denial on the file does not stop. */
+static bool
+maps_file_writable (const struct vma *v) {
+	return v->file != NULL && v->writable && VM_TYPE (v->type) == VM_FILE;
+}
+
+/* Adds a region described by TEMPLATE to SPT and returns it.  The
+ * region takes over TEMPLATE's file, which is closed when the
+ * region is destroyed.  Returns NULL, leaving the file to the
+ * caller, if the region is empty, overlaps another one, or memory
+ * is short. */
+struct vma *
+vma_add (struct supplemental_page_table *spt, const struct vma *template) {
+	struct vma *v;
+
+	ASSERT (pg_ofs (template->start) == 0 && pg_ofs (template->end) == 0);
+
+	if (template->start >= template->end
+		|| vma_overlap (spt, template->start, template->end) != NULL)
+		return NULL;
+	v = malloc_tagged (sizeof *v, MEM_SPT);
+	if (v == NULL)
+		return NULL;
+	*v = *template;
+	v->left = v->right = NULL;
+	v->height = 1;
+	spt->vmas = tree_insert (spt->vmas, v);
+	if (maps_file_writable (v))
+		inode_map_writable (file_get_inode (v->file));
+	return v;
+}
+
+/* Removes region V from SPT and frees it.  Pages already created
+ * for it are left alone. */
+void
+vma_destroy (struct supplemental_page_table *spt, struct vma *v) {
+	spt->vmas = tree_remove (spt->vmas, v);
+	if (maps_file_writable (v))
+		inode_unmap_writable (file_get_inode (v->file));
+	file_close (v->file);
+	free (v);
+}
+
+/* Gives DST a copy of each region of SRC.  A copy of a file
+ * mapping maps the same pages of the file, shared through the
+ * page cache. */
+bool
+vma_copy (struct supplemental_page_table *dst,
+		struct supplemental_page_table *src) {
+	for (struct vma *v = vma_next (src, NULL); v != NULL;
+		v = vma_next (src, v->end)) {
+		struct vma copy = *v;
+
+		if (v->file != NULL) {
+			copy.file = file_reopen (v->file);
+			if (copy.file == NULL)
+				return false;
+		}
+		if (vma_add (dst, &copy) == NULL) {
+			file_close (copy.file);
+			return false;
+		}
+	}
+	return true;
+}
+
+/* Destroys every region of SPT. */
+void
+vma_kill (struct supplemental_page_table *spt) {
+	while (spt->vmas != NULL)
+		vma_destroy (spt, spt->vmas);
+}
@@ -0,0 +1,335 @@
+/* zswap.c: Compressed in-memory tier in front of the swap disk.
+
+   An evicted anonymous page is first compressed with a small
+   LZ77 compressor in the style of LZ4 and, if it shrinks to no
+   more than ZSWAP_MAX_LEN bytes, kept in a pool of kernel pages
+   instead of being written to disk.  Pages that compress poorly,
+   or that do not fit because the pool has reached
+   zswap_max_pages, go to the swap disk as before.
+
+   The pool is a simple slab: each pool page holds objects of one
+   size class, a multiple of ZSWAP_UNIT bytes, and pages that still
+   have room are kept on a list per class. */
+
+#include "vm/zswap.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Objects are stored in multiples of this many bytes. */
+#define ZSWAP_UNIT 256
+
+/* Pages that compress to more than this go to disk. */
+#define ZSWAP_MAX_LEN (PGSIZE * 3 / 4)
+
+#define ZSWAP_CLASS_CNT (ZSWAP_MAX_LEN / ZSWAP_UNIT + 1)
+
+/* A page of the pool. */
+struct zpage {
+	struct list_elem elem;  /* In classes[CLS] while not full. */
+	uint8_t *kva;           /* The pool page itself. */
+	uint16_t used;          /* Bitmap of occupied objects. */
+	uint8_t cls;            /* Objects are CLS * ZSWAP_UNIT bytes. */
+	uint8_t cnt;            /* Number of occupied objects. */
+};
+
+size_t zswap_max_pages = SIZE_MAX;
+
+static struct lock zswap_lock;
+static struct list classes[ZSWAP_CLASS_CNT];
+static size_t pool_pages;
+
+/* Statistics. */
+static unsigned long long store_cnt;    /* Pages stored. */
+static unsigned long long reject_cnt;   /* Pages that compressed poorly. */
+static unsigned long long full_cnt;     /* Pages refused for lack of room. */
+static unsigned long long load_cnt;     /* Pages decompressed. */
+static unsigned long long orig_bytes;   /* Bytes stored, uncompressed. */
+static unsigned long long comp_bytes;   /* Bytes stored, compressed. */
+static size_t peak_pages;
+
+static size_t lz_compress (const uint8_t *src, uint8_t *dst, size_t limit);
+static bool lz_decompress (const uint8_t *src, size_t len, uint8_t *dst);
+
+/* Compression output; protected by ZSWAP_LOCK. */
+static uint8_t comp_buf[ZSWAP_MAX_LEN];
+
+/* Initializes the pool.  Unless set with -zswap, the pool may grow
+ * to an eighth of the user pool, but to no more than a quarter of
+ * the kernel pool, which it is allocated from. */
+void
+zswap_init (void) {
+	lock_init (&zswap_lock);
+	for (size_t i = 0; i < ZSWAP_CLASS_CNT; i++)
+		list_init (&classes[i]);
+
+	if (zswap_max_pages == SIZE_MAX) {
+		size_t user = palloc_free_cnt (PAL_USER) / 8;
+		size_t kernel = palloc_free_cnt (0) / 4;
+		zswap_max_pages = user < kernel ? user : kernel;
+	}
+}
+
+/* Compresses the page at KVA into the pool and fills in *H.
+ * Returns false, leaving *H empty, if the page compresses poorly
+ * or the pool is full, in which case it should go to disk. */
+bool
+zswap_store (const void *kva, struct zswap_handle *h) {
+	struct zpage *zp = NULL;
+	size_t len, cls, idx;
+
+	h->zpage = NULL;
+	if (zswap_max_pages == 0)
+		return false;
+
+	lock_acquire (&zswap_lock);
+	len = lz_compress (kva, comp_buf, ZSWAP_MAX_LEN);
+	if (len == 0) {
+		reject_cnt++;
+		goto out;
+	}
+
+	cls = DIV_ROUND_UP (len, ZSWAP_UNIT);
+	if (!list_empty (&classes[cls]))
+		zp = list_entry (list_front (&classes[cls]), struct zpage, elem);
+	else if (pool_pages < zswap_max_pages) {
+		zp = malloc_tagged (sizeof *zp, MEM_SWAP);
+		if (zp != NULL) {
+			zp->kva = palloc_get_page (PAL_TAG (MEM_SWAP));
+			if (zp->kva == NULL) {
+				free (zp);
+				zp = NULL;
+			}
+		}
+		if (zp != NULL) {
+			zp->used = 0;
+			zp->cls = cls;
+			zp->cnt = 0;
+			list_push_front (&classes[cls], &zp->elem);
+			if (++pool_pages > peak_pages)
+				peak_pages = pool_pages;
+		}
+	}
+	if (zp == NULL) {
+		full_cnt++;
+		goto out;
+	}
+
+	for (idx = 0; zp->used & (1u << idx); idx++)
+		continue;
+	memcpy (zp->kva + idx * cls * ZSWAP_UNIT, comp_buf, len);
+	zp->used |= 1u << idx;
+	if (++zp->cnt == PGSIZE / (cls * ZSWAP_UNIT))
+		list_remove (&zp->elem);
+
+	h->zpage = zp;
+	h->idx = idx;
+	h->len = len;
+	store_cnt++;
+	orig_bytes += PGSIZE;
+	comp_bytes += len;
+
+out:
+	lock_release (&zswap_lock);
+	return h->zpage != NULL;
+}
+
+/* Decompresses the page held by H into KVA.  H keeps holding it. */
+bool
+zswap_load (const struct zswap_handle *h, void *kva) {
+	struct zpage *zp = h->zpage;
+	bool ok;
+
+	ASSERT (zp != NULL);
+
+	lock_acquire (&zswap_lock);
+	ok = lz_decompress (zp->kva + h->idx * zp->cls * ZSWAP_UNIT, h->len, kva);
+	load_cnt++;
+	lock_release (&zswap_lock);
+	return ok;
+}
+
+/* Drops the page held by H, if any. */
+void
+zswap_free (struct zswap_handle *h) {
+	struct zpage *zp = h->zpage;
+
+	if (zp == NULL)
+		return;
+
+	lock_acquire (&zswap_lock);
+	ASSERT (zp->used & (1u << h->idx));
+	if (zp->cnt-- == PGSIZE / (zp->cls * ZSWAP_UNIT))
+		list_push_front (&classes[zp->cls], &zp->elem);
+	zp->used &= ~(1u << h->idx);
+	if (zp->cnt == 0) {
+		list_remove (&zp->elem);
+		palloc_free_page (zp->kva);
+		free (zp);
+		pool_pages--;
+	}
+	lock_release (&zswap_lock);
+
+	h->zpage = NULL;
+}
+
+/* Prints pool statistics. */
+void
+zswap_print_stats (void) {
+	unsigned long long pct = orig_bytes ? comp_bytes * 100 / orig_bytes : 0;
+
+	if (store_cnt == 0 && reject_cnt == 0 && full_cnt == 0)
+		return;
+	printf ("zswap: %llu stored (%llu%% of original size), %llu loaded, "
+			"%llu incompressible, %llu pool full; "
+			"%zu of %zu pages, peak %zu\n",
+			store_cnt, pct, load_cnt, reject_cnt, full_cnt,
+			pool_pages, zswap_max_pages, peak_pages);
+}
+
+/* LZ compression.
+
+   The output is a series of sequences, each a token byte, a run
+   of literal bytes, and a back-reference.  The token's high
+   nibble is the literal count and its low nibble the match length
+   less LZ_MIN_MATCH; a nibble of 15 is continued in following
+   bytes, each added to it, until one is less than 255.  The
+   literals follow, then the match offset as 2 bytes, little
+   endian.  The final sequence has literals only. */
+
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 12
+
+/* Last position at which each hashed 4-byte sequence was seen;
+ * protected by ZSWAP_LOCK. */
+static uint16_t lz_table[1 << LZ_HASH_BITS];
+
+static inline uint32_t
+read32 (const uint8_t *p) {
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+static inline size_t
+lz_hash (uint32_t seq) {
+	return (seq * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/* Appends length extension bytes for LEN at DST[*OP]. */
+static void
+put_len (uint8_t *dst, size_t *op, size_t len) {
+	for (len -= 15; len >= 255; len -= 255)
+		dst[(*op)++] = 255;
+	dst[(*op)++] = len;
+}
+
+/* Appends a sequence of LIT_LEN literals from LIT, then a match of
+ * MATCH_LEN bytes OFFSET back, unless MATCH_LEN is 0.  Returns
+ * false if that would take DST past LIMIT bytes. */
+static bool
+put_seq (uint8_t *dst, size_t *op, size_t limit, const uint8_t *lit,
+		size_t lit_len, size_t offset, size_t match_len) {
+	size_t ml = match_len ? match_len - LZ_MIN_MATCH : 0;
+
+	if (*op + 1 + lit_len / 255 + 1 + lit_len + 2 + ml / 255 + 1 > limit)
+		return false;
+
+	dst[(*op)++] = (lit_len < 15 ? lit_len : 15) << 4 | (ml < 15 ? ml : 15);
+	if (lit_len >= 15)
+		put_len (dst, op, lit_len);
+	memcpy (dst + *op, lit, lit_len);
+	*op += lit_len;
+	if (match_len == 0)
+		return true;
+
+	dst[(*op)++] = offset;
+	dst[(*op)++] = offset >> 8;
+	if (ml >= 15)
+		put_len (dst, op, ml);
+	return true;
+}
+
+/* Compresses the page at SRC into DST, which has room for LIMIT
+ * bytes.  Returns the compressed length, or 0 if it would not be
+ * smaller than LIMIT.  Stale entries in LZ_TABLE are harmless:
+ * every candidate is compared before it is used. */
+static size_t
+lz_compress (const uint8_t *src, uint8_t *dst, size_t limit) {
+	size_t ip = 0, anchor = 0, op = 0;
+
+	while (ip + LZ_MIN_MATCH <= PGSIZE) {
+		uint32_t seq = read32 (src + ip);
+		size_t h = lz_hash (seq);
+		size_t cand = lz_table[h];
+
+		lz_table[h] = ip;
+		if (cand < ip && read32 (src + cand) == seq) {
+			size_t len = LZ_MIN_MATCH;
+			while (ip + len < PGSIZE && src[cand + len] == src[ip + len])
+				len++;
+			if (!put_seq (dst, &op, limit, src + anchor, ip - anchor,
+						ip - cand, len))
+				return 0;
+			ip += len;
+			anchor = ip;
+		} else
+			ip++;
+	}
+	if (!put_seq (dst, &op, limit, src + anchor, PGSIZE - anchor, 0, 0))
+		return 0;
+	return op;
+}
+
+/* Reads a length extended past 15 from SRC[*IP]. */
+static bool
+get_len (const uint8_t *src, size_t *ip, size_t len, size_t *n) {
+	uint8_t b;
+	do {
+		if (*ip >= len)
+			return false;
+		b = src[(*ip)++];
+		*n += b;
+	} while (b == 255);
+	return true;
+}
+
+/* Decompresses LEN bytes at SRC into the page at DST.  Returns
+ * false if the data is corrupt. */
+static bool
+lz_decompress (const uint8_t *src, size_t len, uint8_t *dst) {
+	size_t ip = 0, op = 0;
+
+	while (ip < len) {
+		uint8_t token = src[ip++];
+		size_t lit = token >> 4, ml = token & 15, offset;
+
+		if (lit == 15 && !get_len (src, &ip, len, &lit))
+			return false;
+		if (lit > len - ip || lit > PGSIZE - op)
+			return false;
+		memcpy (dst + op, src + ip, lit);
+		ip += lit;
+		op += lit;
+		if (ip == len)
+			break;
+
+		if (len - ip < 2)
+			return false;
+		offset = src[ip] | src[ip + 1] << 8;
+		ip += 2;
+		if (ml == 15 && !get_len (src, &ip, len, &ml))
+			return false;
+		ml += LZ_MIN_MATCH;
+		if (offset == 0 || offset > op || ml > PGSIZE - op)
+			return false;
+		/* Byte by byte: the match may overlap its own output. */
+		for (; ml > 0; ml--, op++)
+			dst[op] = dst[op - offset];
+	}
+	return op == PGSIZE;
+}